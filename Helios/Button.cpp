@@ -14,27 +14,27 @@
 #include "Helios.h"
 
 // static members of Button
-uint32_t Button::m_pressTime = 0;
-uint32_t Button::m_releaseTime = 0;
-uint32_t Button::m_holdDuration = 0;
-uint32_t Button::m_releaseDuration = 0;
-uint8_t Button::m_releaseCount = 0;
-bool Button::m_buttonState = false;
-bool Button::m_newPress = false;
-bool Button::m_newRelease = false;
-bool Button::m_isPressed = false;
-bool Button::m_shortClick = false;
-bool Button::m_longClick = false;
-bool Button::m_holdClick = false;
+HELIOS_LOCAL uint32_t Button::m_pressTime = 0;
+HELIOS_LOCAL uint32_t Button::m_releaseTime = 0;
+HELIOS_LOCAL uint32_t Button::m_holdDuration = 0;
+HELIOS_LOCAL uint32_t Button::m_releaseDuration = 0;
+HELIOS_LOCAL uint8_t Button::m_releaseCount = 0;
+HELIOS_LOCAL bool Button::m_buttonState = false;
+HELIOS_LOCAL bool Button::m_newPress = false;
+HELIOS_LOCAL bool Button::m_newRelease = false;
+HELIOS_LOCAL bool Button::m_isPressed = false;
+HELIOS_LOCAL bool Button::m_shortClick = false;
+HELIOS_LOCAL bool Button::m_longClick = false;
+HELIOS_LOCAL bool Button::m_holdClick = false;
 
 #ifdef HELIOS_CLI
 // an input queue for the button, each tick one even is processed
 // out of this queue and used to produce input
-std::queue<char> Button::m_inputQueue;
+HELIOS_LOCAL std::deque<char> Button::m_inputQueue;
 // the virtual pin state
-bool Button::m_pinState = false;
+HELIOS_LOCAL bool Button::m_pinState = false;
 // whether the button is waiting to wake the device
-bool Button::m_enableWake = false;
+HELIOS_LOCAL bool Button::m_enableWake = false;
 #endif
 
 // initialize a new button object with a pin number
@@ -191,7 +191,7 @@ bool Button::processPreInput()
     return false;
   }
   // now pop whatever pre-input command was processed
-  m_inputQueue.pop();
+  m_inputQueue.pop_front();
   return true;
 }
 
@@ -214,7 +214,7 @@ bool Button::processPostInput()
     // should never happen
     return false;
   }
-  m_inputQueue.pop();
+  m_inputQueue.pop_front();
   return true;
 }
 
@@ -265,13 +265,23 @@ void Button::doToggle()
 // queue up an input event for the button
 void Button::queueInput(char input)
 {
-  m_inputQueue.push(input);
+  m_inputQueue.push_back(input);
 }
 
 uint32_t Button::inputQueueSize()
 {
   return m_inputQueue.size();
 }
+
+uint32_t Button::skipWaits(uint32_t maxWaits)
+{
+  uint32_t skipped = 0;
+  while (skipped < maxWaits && m_inputQueue.size() > 1 && m_inputQueue.front() == 'w') {
+    m_inputQueue.pop_front();
+    skipped++;
+  }
+  return skipped;
+}
 #endif
 
 // global button
@@ -1,7 +1,9 @@
 #include <stdint.h>
 
+#include "HeliosConfig.h"
+
 #ifdef HELIOS_CLI
-#include <queue>
+#include <deque>
 #endif
 
 class Button
@@ -68,6 +70,11 @@ public:
   // queue up an input event for the button
   static void queueInput(char input);
   static uint32_t inputQueueSize();
+
+  // pop up to some number of waits off the front of the input queue as if
+  // that many ticks had passed, the last input is never popped so that the
+  // queue doesn't run dry early. Returns the number of waits that were popped
+  static uint32_t skipWaits(uint32_t maxWaits);
 #endif
 
 private:
@@ -75,33 +82,33 @@ private:
   // state data that is populated each check
 
   // the timestamp of when the button was pressed
-  static uint32_t m_pressTime;
+  static HELIOS_LOCAL uint32_t m_pressTime;
   // the timestamp of when the button was released
-  static uint32_t m_releaseTime;
+  static HELIOS_LOCAL uint32_t m_releaseTime;
 
   // the last hold duration
-  static uint32_t m_holdDuration;
+  static HELIOS_LOCAL uint32_t m_holdDuration;
   // the last release duration
-  static uint32_t m_releaseDuration;
+  static HELIOS_LOCAL uint32_t m_releaseDuration;
 
   // the number of times released, will overflow at 255
-  static uint8_t m_releaseCount;
+  static HELIOS_LOCAL uint8_t m_releaseCount;
 
   // the active state of the button
-  static bool m_buttonState;
+  static HELIOS_LOCAL bool m_buttonState;
 
   // whether pressed this tick
-  static bool m_newPress;
+  static HELIOS_LOCAL bool m_newPress;
   // whether released this tick
-  static bool m_newRelease;
+  static HELIOS_LOCAL bool m_newRelease;
   // whether currently pressed
-  static bool m_isPressed;
+  static HELIOS_LOCAL bool m_isPressed;
   // whether a short click occurred
-  static bool m_shortClick;
+  static HELIOS_LOCAL bool m_shortClick;
   // whether a long click occurred
-  static bool m_longClick;
+  static HELIOS_LOCAL bool m_longClick;
   // whether a long hold occurred
-  static bool m_holdClick;
+  static HELIOS_LOCAL bool m_holdClick;
 
 #ifdef HELIOS_CLI
   // process pre or post input events from the queue
@@ -110,10 +117,13 @@ private:
 
   // an input queue for the button, each tick one even is processed
   // out of this queue and used to produce input
-  static std::queue<char> m_inputQueue;
+  static HELIOS_LOCAL std::deque<char> m_inputQueue;
   // the virtual pin state that is polled instead of a digital pin
-  static bool m_pinState;
+  static HELIOS_LOCAL bool m_pinState;
   // whether the button is waiting to wake the device
-  static bool m_enableWake;
+  static HELIOS_LOCAL bool m_enableWake;
+
+  // the engine context swaps this state in and out
+  friend class EngineContext;
 #endif
 };
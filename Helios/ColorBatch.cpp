@@ -0,0 +1,347 @@
+#include "ColorBatch.h"
+
+#ifdef HELIOS_CLI
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BATCH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BATCH_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BATCH_NEON
+#endif
+
+// the byte shuffle for the bgr packing came in with ssse3
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+// the colors are read and written as plain arrays of 3 bytes
+static_assert(sizeof(RGBColor) == 3 && sizeof(HSVColor) == 3, "colors must be 3 bytes");
+
+// ========================================================
+//  The lanes that the colors are worked on
+//
+// Each channel is worked on as floats, every product in the conversions fits
+// in the 24 bits of a float so the math is exact and truncating gives exactly
+// what the integer math gives. Each set of lanes is filled from BATCH_LANES
+// bytes of one channel
+
+#if defined(BATCH_AVX2)
+#define BATCH_LANES 8
+typedef __m256 lanes;
+typedef __m256 lane_mask;
+static inline lanes lanes_set(float f) { return _mm256_set1_ps(f); }
+static inline lanes lanes_add(lanes a, lanes b) { return _mm256_add_ps(a, b); }
+static inline lanes lanes_sub(lanes a, lanes b) { return _mm256_sub_ps(a, b); }
+static inline lanes lanes_mul(lanes a, lanes b) { return _mm256_mul_ps(a, b); }
+static inline lanes lanes_div(lanes a, lanes b) { return _mm256_div_ps(a, b); }
+static inline lanes lanes_min(lanes a, lanes b) { return _mm256_min_ps(a, b); }
+static inline lanes lanes_max(lanes a, lanes b) { return _mm256_max_ps(a, b); }
+static inline lanes lanes_trunc(lanes a) { return _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+static inline lane_mask lanes_eq(lanes a, lanes b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+static inline lane_mask lanes_lt(lanes a, lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline lane_mask mask_or(lane_mask a, lane_mask b) { return _mm256_or_ps(a, b); }
+static inline lanes lanes_select(lane_mask m, lanes a, lanes b) { return _mm256_blendv_ps(b, a, m); }
+static inline lanes lanes_load(const uint8_t *p)
+{
+  return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p)));
+}
+static inline void lanes_store(uint8_t *p, lanes a)
+{
+  // the low byte of each lane
+  __m256i i = _mm256_and_si256(_mm256_cvttps_epi32(a), _mm256_set1_epi32(0xFF));
+  __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+  _mm_storel_epi64((__m128i *)p, _mm_packus_epi16(w, w));
+}
+#elif defined(BATCH_SSE2)
+#define BATCH_LANES 4
+typedef __m128 lanes;
+typedef __m128 lane_mask;
+static inline lanes lanes_set(float f) { return _mm_set1_ps(f); }
+static inline lanes lanes_add(lanes a, lanes b) { return _mm_add_ps(a, b); }
+static inline lanes lanes_sub(lanes a, lanes b) { return _mm_sub_ps(a, b); }
+static inline lanes lanes_mul(lanes a, lanes b) { return _mm_mul_ps(a, b); }
+static inline lanes lanes_div(lanes a, lanes b) { return _mm_div_ps(a, b); }
+static inline lanes lanes_min(lanes a, lanes b) { return _mm_min_ps(a, b); }
+static inline lanes lanes_max(lanes a, lanes b) { return _mm_max_ps(a, b); }
+// there is no round instruction till sse4.1 but every value is far below 2^31
+static inline lanes lanes_trunc(lanes a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+static inline lane_mask lanes_eq(lanes a, lanes b) { return _mm_cmpeq_ps(a, b); }
+static inline lane_mask lanes_lt(lanes a, lanes b) { return _mm_cmplt_ps(a, b); }
+static inline lane_mask mask_or(lane_mask a, lane_mask b) { return _mm_or_ps(a, b); }
+static inline lanes lanes_select(lane_mask m, lanes a, lanes b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+static inline lanes lanes_load(const uint8_t *p)
+{
+  int32_t word;
+  memcpy(&word, p, sizeof(word));
+  __m128i zero = _mm_setzero_si128();
+  __m128i bytes = _mm_cvtsi32_si128(word);
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+static inline void lanes_store(uint8_t *p, lanes a)
+{
+  // the low byte of each lane
+  __m128i i = _mm_and_si128(_mm_cvttps_epi32(a), _mm_set1_epi32(0xFF));
+  __m128i w = _mm_packs_epi32(i, i);
+  int32_t word = _mm_cvtsi128_si32(_mm_packus_epi16(w, w));
+  memcpy(p, &word, sizeof(word));
+}
+#elif defined(BATCH_NEON)
+#define BATCH_LANES 4
+typedef float32x4_t lanes;
+typedef uint32x4_t lane_mask;
+static inline lanes lanes_set(float f) { return vdupq_n_f32(f); }
+static inline lanes lanes_add(lanes a, lanes b) { return vaddq_f32(a, b); }
+static inline lanes lanes_sub(lanes a, lanes b) { return vsubq_f32(a, b); }
+static inline lanes lanes_mul(lanes a, lanes b) { return vmulq_f32(a, b); }
+static inline lanes lanes_div(lanes a, lanes b) { return vdivq_f32(a, b); }
+static inline lanes lanes_min(lanes a, lanes b) { return vminq_f32(a, b); }
+static inline lanes lanes_max(lanes a, lanes b) { return vmaxq_f32(a, b); }
+static inline lanes lanes_trunc(lanes a) { return vrndq_f32(a); }
+static inline lane_mask lanes_eq(lanes a, lanes b) { return vceqq_f32(a, b); }
+static inline lane_mask lanes_lt(lanes a, lanes b) { return vcltq_f32(a, b); }
+static inline lane_mask mask_or(lane_mask a, lane_mask b) { return vorrq_u32(a, b); }
+static inline lanes lanes_select(lane_mask m, lanes a, lanes b) { return vbslq_f32(m, a, b); }
+static inline lanes lanes_load(const uint8_t *p)
+{
+  uint32_t word;
+  memcpy(&word, p, sizeof(word));
+  uint16x8_t wide = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(word)));
+  return vcvtq_f32_u32(vmovl_u16(vget_low_u16(wide)));
+}
+static inline void lanes_store(uint8_t *p, lanes a)
+{
+  // the low byte of each lane
+  uint32x4_t i = vandq_u32(vreinterpretq_u32_s32(vcvtq_s32_f32(a)), vdupq_n_u32(0xFF));
+  uint16x4_t w = vmovn_u32(i);
+  uint32_t word = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(w, w))), 0);
+  memcpy(p, &word, sizeof(word));
+}
+#endif
+
+#ifdef BATCH_LANES
+// how many colors are split into channels at a time
+#define BATCH_BLOCK 256
+
+// a block of colors split into one array per channel
+struct ColorPlanes
+{
+  uint8_t channel[3][BATCH_BLOCK];
+};
+
+// split some colors into their channels or put them back together
+static void split_planes(const uint8_t *colors, ColorPlanes &planes, uint32_t count)
+{
+  for (uint32_t i = 0; i < count; ++i) {
+    planes.channel[0][i] = colors[i * 3];
+    planes.channel[1][i] = colors[i * 3 + 1];
+    planes.channel[2][i] = colors[i * 3 + 2];
+  }
+}
+
+static void join_planes(const ColorPlanes &planes, uint8_t *colors, uint32_t count)
+{
+  for (uint32_t i = 0; i < count; ++i) {
+    colors[i * 3] = planes.channel[0][i];
+    colors[i * 3 + 1] = planes.channel[1][i];
+    colors[i * 3 + 2] = planes.channel[2][i];
+  }
+}
+
+// hsv_to_rgb_generic_math on each lane
+static inline void hsv_to_rgb_lanes(lanes hue, lanes sat, lanes val, lanes &red, lanes &green, lanes &blue)
+{
+  const lanes full = lanes_set(255);
+  // >> 8 is a multiply by 1/256 then truncate
+  const lanes shift = lanes_set(1.0f / 256);
+  // hue * 1525 >> 16 is hue / 43 for every hue
+  lanes region = lanes_trunc(lanes_mul(hue, lanes_set(1525.0f / 65536)));
+  lanes remainder = lanes_mul(lanes_sub(hue, lanes_mul(region, lanes_set(43))), lanes_set(6));
+  lanes p = lanes_trunc(lanes_mul(lanes_mul(val, lanes_sub(full, sat)), shift));
+  lanes q = lanes_trunc(lanes_mul(lanes_mul(val, lanes_sub(full,
+            lanes_trunc(lanes_mul(lanes_mul(sat, remainder), shift)))), shift));
+  lanes t = lanes_trunc(lanes_mul(lanes_mul(val, lanes_sub(full,
+            lanes_trunc(lanes_mul(lanes_mul(sat, lanes_sub(full, remainder)), shift)))), shift));
+  lane_mask r0 = lanes_eq(region, lanes_set(0));
+  lane_mask r1 = lanes_eq(region, lanes_set(1));
+  lane_mask r2 = lanes_eq(region, lanes_set(2));
+  lane_mask r3 = lanes_eq(region, lanes_set(3));
+  lane_mask r4 = lanes_eq(region, lanes_set(4));
+  lane_mask r5 = lanes_eq(region, lanes_set(5));
+  red = lanes_select(mask_or(r0, r5), val, lanes_select(r1, q, lanes_select(r4, t, p)));
+  green = lanes_select(r0, t, lanes_select(mask_or(r1, r2), val, lanes_select(r3, q, p)));
+  blue = lanes_select(r2, t, lanes_select(mask_or(r3, r4), val, lanes_select(r5, q, p)));
+  // no saturation is just a shade of white
+  lane_mask grey = lanes_eq(sat, lanes_set(0));
+  red = lanes_select(grey, val, red);
+  green = lanes_select(grey, val, green);
+  blue = lanes_select(grey, val, blue);
+}
+
+// rgb_to_hsv_generic on each lane
+static inline void rgb_to_hsv_lanes(lanes red, lanes green, lanes blue, lanes &hue, lanes &sat, lanes &val)
+{
+  const lanes one = lanes_set(1);
+  lanes rgbMax = lanes_max(lanes_max(red, green), blue);
+  lanes rgbMin = lanes_min(lanes_min(red, green), blue);
+  lanes range = lanes_sub(rgbMax, rgbMin);
+  val = rgbMax;
+  // the divisors are kept at least 1, the lanes they would be 0 for are black
+  // or white which end up with no hue or saturation anyway
+  sat = lanes_trunc(lanes_div(lanes_mul(range, lanes_set(255)), lanes_max(rgbMax, one)));
+  lane_mask maxRed = lanes_eq(rgbMax, red);
+  lane_mask maxGreen = lanes_eq(rgbMax, green);
+  lanes diff = lanes_select(maxRed, lanes_sub(green, blue),
+               lanes_select(maxGreen, lanes_sub(blue, red), lanes_sub(red, green)));
+  lanes base = lanes_select(maxRed, lanes_set(0), lanes_select(maxGreen, lanes_set(85), lanes_set(171)));
+  hue = lanes_add(base, lanes_trunc(lanes_div(lanes_mul(diff, lanes_set(43)), lanes_max(range, one))));
+  // a hue just below red wraps around to the top like it does in a uint8
+  hue = lanes_select(lanes_lt(hue, lanes_set(0)), lanes_add(hue, lanes_set(256)), hue);
+  hue = lanes_select(lanes_eq(sat, lanes_set(0)), lanes_set(0), hue);
+}
+
+// whether hsv to rgb is the generic conversion that the lanes do
+static bool batch_generic()
+{
+#if ALTERNATIVE_HSV_RGB == 1
+  return g_hsv_rgb_alg == HSV_TO_RGB_GENERIC;
+#else
+  return true;
+#endif
+}
+#endif
+
+void hsv_to_rgb_batch(const HSVColor *in, RGBColor *out, uint32_t count)
+{
+#ifdef BATCH_LANES
+  if (batch_generic()) {
+    ColorPlanes planes;
+    for (uint32_t i = 0; i < count; i += BATCH_BLOCK) {
+      uint32_t block = (count - i < BATCH_BLOCK) ? count - i : BATCH_BLOCK;
+      split_planes((const uint8_t *)(in + i), planes, block);
+      for (uint32_t j = 0; j < block; j += BATCH_LANES) {
+        lanes red, green, blue;
+        hsv_to_rgb_lanes(lanes_load(planes.channel[0] + j), lanes_load(planes.channel[1] + j),
+                         lanes_load(planes.channel[2] + j), red, green, blue);
+        lanes_store(planes.channel[0] + j, red);
+        lanes_store(planes.channel[1] + j, green);
+        lanes_store(planes.channel[2] + j, blue);
+      }
+      join_planes(planes, (uint8_t *)(out + i), block);
+    }
+    return;
+  }
+#endif
+  for (uint32_t i = 0; i < count; ++i) {
+    out[i] = in[i];
+  }
+}
+
+void rgb_to_hsv_batch(const RGBColor *in, HSVColor *out, uint32_t count)
+{
+#ifdef BATCH_LANES
+  ColorPlanes planes;
+  for (uint32_t i = 0; i < count; i += BATCH_BLOCK) {
+    uint32_t block = (count - i < BATCH_BLOCK) ? count - i : BATCH_BLOCK;
+    split_planes((const uint8_t *)(in + i), planes, block);
+    for (uint32_t j = 0; j < block; j += BATCH_LANES) {
+      lanes hue, sat, val;
+      rgb_to_hsv_lanes(lanes_load(planes.channel[0] + j), lanes_load(planes.channel[1] + j),
+                       lanes_load(planes.channel[2] + j), hue, sat, val);
+      lanes_store(planes.channel[0] + j, hue);
+      lanes_store(planes.channel[1] + j, sat);
+      lanes_store(planes.channel[2] + j, val);
+    }
+    join_planes(planes, (uint8_t *)(out + i), block);
+  }
+#else
+  for (uint32_t i = 0; i < count; ++i) {
+    out[i] = in[i];
+  }
+#endif
+}
+
+void scale_brightness_batch(const RGBColor *in, RGBColor *out, uint32_t count, float scale)
+{
+  // every channel is scaled the same so the colors are just a run of bytes
+  const uint8_t *src = (const uint8_t *)in;
+  uint8_t *dest = (uint8_t *)out;
+  uint32_t size = count * 3;
+  uint32_t i = 0;
+#ifdef BATCH_LANES
+  const lanes factor = lanes_set(scale);
+  const lanes full = lanes_set(255);
+  for (; i + BATCH_LANES <= size; i += BATCH_LANES) {
+    lanes_store(dest + i, lanes_min(lanes_mul(lanes_load(src + i), factor), full));
+  }
+#endif
+  for (; i < size; ++i) {
+    float scaled = (float)src[i] * scale;
+    dest[i] = (uint8_t)(scaled > 255 ? 255 : scaled);
+  }
+}
+
+void bring_up_brightness_batch(const RGBColor *in, RGBColor *out, uint32_t count, uint8_t min_brightness)
+{
+#ifdef BATCH_LANES
+  if (batch_generic()) {
+    const lanes zero = lanes_set(0);
+    const lanes lowest = lanes_set(min_brightness);
+    ColorPlanes planes;
+    for (uint32_t i = 0; i < count; i += BATCH_BLOCK) {
+      uint32_t block = (count - i < BATCH_BLOCK) ? count - i : BATCH_BLOCK;
+      split_planes((const uint8_t *)(in + i), planes, block);
+      for (uint32_t j = 0; j < block; j += BATCH_LANES) {
+        lanes hue, sat, val, red, green, blue;
+        rgb_to_hsv_lanes(lanes_load(planes.channel[0] + j), lanes_load(planes.channel[1] + j),
+                         lanes_load(planes.channel[2] + j), hue, sat, val);
+        // black stays black, anything else is at least the minimum
+        val = lanes_select(lanes_eq(val, zero), zero, lanes_max(val, lowest));
+        hsv_to_rgb_lanes(hue, sat, val, red, green, blue);
+        lanes_store(planes.channel[0] + j, red);
+        lanes_store(planes.channel[1] + j, green);
+        lanes_store(planes.channel[2] + j, blue);
+      }
+      join_planes(planes, (uint8_t *)(out + i), block);
+    }
+    return;
+  }
+#endif
+  for (uint32_t i = 0; i < count; ++i) {
+    RGBColor col = in[i];
+    out[i] = col.bringUpBrightness(min_brightness);
+  }
+}
+
+void pack_bgr_batch(const RGBColor *in, uint8_t *out, uint32_t count)
+{
+  uint32_t i = 0;
+#if defined(__SSSE3__)
+  // 5 colors at a time, 16 bytes are loaded and stored but the last one is
+  // part of the next color so it's rewritten by the next round
+  const __m128i swap = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+  for (; i + 6 <= count; i += 5) {
+    __m128i colors = _mm_loadu_si128((const __m128i *)(in + i));
+    _mm_storeu_si128((__m128i *)(out + i * 3), _mm_shuffle_epi8(colors, swap));
+  }
+#elif defined(BATCH_NEON)
+  // 16 colors at a time, neon can split and join the channels on its own
+  for (; i + 16 <= count; i += 16) {
+    uint8x16x3_t rgb = vld3q_u8((const uint8_t *)(in + i));
+    uint8x16x3_t bgr = { { rgb.val[2], rgb.val[1], rgb.val[0] } };
+    vst3q_u8(out + i * 3, bgr);
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i * 3] = in[i].blue;
+    out[i * 3 + 1] = in[i].green;
+    out[i * 3 + 2] = in[i].red;
+  }
+}
+
+#endif
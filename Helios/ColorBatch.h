@@ -0,0 +1,31 @@
+#ifndef COLOR_BATCH_H
+#define COLOR_BATCH_H
+
+#include <inttypes.h>
+
+#include "HeliosConfig.h"
+#include "Colortypes.h"
+
+#ifdef HELIOS_CLI
+// Batch Color Conversions
+//
+// These convert a whole array of colors at a time for the host tools, each
+// one gives exactly the same colors as converting the colors one at a time
+// with the functions in Colortypes.h. The colors are worked on several at a
+// time with SSE2 on x86, AVX2 if the build targets it (-mavx2 or -march=native)
+// or NEON on arm64, otherwise they just loop over the single color versions.
+// The input and output can be the same array
+
+// RGBColor(hsv) for each color, this follows g_hsv_rgb_alg
+void hsv_to_rgb_batch(const HSVColor *in, RGBColor *out, uint32_t count);
+// HSVColor(rgb) for each color
+void rgb_to_hsv_batch(const RGBColor *in, HSVColor *out, uint32_t count);
+// RGBColor::scaleBrightness(scale) for each color
+void scale_brightness_batch(const RGBColor *in, RGBColor *out, uint32_t count, float scale);
+// RGBColor::bringUpBrightness(min_brightness) for each color
+void bring_up_brightness_batch(const RGBColor *in, RGBColor *out, uint32_t count, uint8_t min_brightness);
+// write the colors out as 3 bytes each in blue, green, red order like a bmp
+void pack_bgr_batch(const RGBColor *in, uint8_t *out, uint32_t count);
+#endif
+
+#endif
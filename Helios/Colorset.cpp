@@ -9,6 +9,72 @@
 // the 0th color in the colorset and after the index will be 0
 #define INDEX_INVALID 255
 
+// how each color of a packed colorset is stored, this takes two bits per
+// color in the header after the three bits with the number of colors
+enum PackedColor : uint8_t
+{
+  // one byte index of a color the color select menu can make
+  PACKED_MENU = 0,
+  // one byte brightness of a white, this includes off
+  PACKED_WHITE = 1,
+  // three bytes of any other color
+  PACKED_RGB = 2,
+};
+#define PACKED_HEADER_SIZE 2
+#if NUM_COLOR_SLOTS > 6
+#error "the packed colorset header only has room for 6 colors"
+#endif
+#define PACKED_KIND(header, index) (((header) >> (3 + ((index) * 2))) & 0x3)
+
+// the hues, saturations and values of the color select menu in the same
+// order as the menu, a menu color is packed as hue * 16 + sat * 4 + val
+static const uint8_t menu_hues[16] = {
+  HUE_RED,        HUE_CORAL_ORANGE, HUE_ORANGE,   HUE_YELLOW,
+  HUE_LIME_GREEN, HUE_GREEN,        HUE_SEAFOAM,  HUE_TURQUOISE,
+  HUE_ICE_BLUE,   HUE_LIGHT_BLUE,   HUE_BLUE,     HUE_ROYAL_BLUE,
+  HUE_PURPLE,     HUE_PINK,         HUE_HOT_PINK, HUE_MAGENTA,
+};
+static const uint8_t menu_sats[4] = { HSV_SAT_HIGH, HSV_SAT_MEDIUM, HSV_SAT_LOW, HSV_SAT_LOWEST };
+static const uint8_t menu_vals[4] = { HSV_VAL_HIGH, HSV_VAL_MEDIUM, HSV_VAL_LOW, HSV_VAL_LOWEST };
+
+// the color of a menu index, this is converted the same way as the menu
+static RGBColor menu_color(uint8_t index)
+{
+  HSVColor hsv(menu_hues[index >> 4], menu_sats[(index >> 2) & 0x3], menu_vals[index & 0x3]);
+#if ALTERNATIVE_HSV_RGB == 1
+  return hsv_to_rgb_rainbow(hsv);
+#else
+  return hsv_to_rgb_generic(hsv);
+#endif
+}
+
+// find the menu index of a color, if the menu can make it
+static bool find_menu_index(RGBColor col, uint8_t &index)
+{
+#if ALTERNATIVE_HSV_RGB == 0
+  // the brightest channel of a generic hsv color is always the value
+  uint8_t brightest = col.red;
+  if (col.green > brightest) {
+    brightest = col.green;
+  }
+  if (col.blue > brightest) {
+    brightest = col.blue;
+  }
+#endif
+  for (uint16_t i = 0; i < 256; ++i) {
+#if ALTERNATIVE_HSV_RGB == 0
+    if (menu_vals[i & 0x3] != brightest) {
+      continue;
+    }
+#endif
+    if (menu_color((uint8_t)i) == col) {
+      index = (uint8_t)i;
+      return true;
+    }
+  }
+  return false;
+}
+
 Colorset::Colorset() :
   m_palette(),
   m_numColors(0),
@@ -363,3 +429,84 @@ bool Colorset::onEnd() const
   }
   return (m_curIndex == m_numColors - 1);
 }
+
+uint8_t Colorset::pack(uint8_t *buf) const
+{
+  uint16_t header = m_numColors;
+  uint8_t size = PACKED_HEADER_SIZE;
+  for (uint8_t i = 0; i < m_numColors; ++i) {
+    RGBColor col = m_palette[i];
+    uint8_t index;
+    if (col.red == col.green && col.green == col.blue) {
+      header |= (uint16_t)PACKED_WHITE << (3 + (i * 2));
+      buf[size++] = col.red;
+    } else if (find_menu_index(col, index)) {
+      header |= (uint16_t)PACKED_MENU << (3 + (i * 2));
+      buf[size++] = index;
+    } else {
+      header |= (uint16_t)PACKED_RGB << (3 + (i * 2));
+      buf[size++] = col.red;
+      buf[size++] = col.green;
+      buf[size++] = col.blue;
+    }
+  }
+  buf[0] = (uint8_t)(header & 0xFF);
+  buf[1] = (uint8_t)(header >> 8);
+  return size;
+}
+
+bool Colorset::unpack(const uint8_t *buf)
+{
+  if (!packedSize(buf)) {
+    return false;
+  }
+  uint16_t header = buf[0] | ((uint16_t)buf[1] << 8);
+  clear();
+  m_numColors = header & 0x7;
+  const uint8_t *data = buf + PACKED_HEADER_SIZE;
+  for (uint8_t i = 0; i < m_numColors; ++i) {
+    switch (PACKED_KIND(header, i)) {
+    case PACKED_MENU:
+      m_palette[i] = menu_color(*data++);
+      break;
+    case PACKED_WHITE:
+      m_palette[i] = RGBColor(data[0], data[0], data[0]);
+      data++;
+      break;
+    default:
+      m_palette[i] = RGBColor(data[0], data[1], data[2]);
+      data += 3;
+      break;
+    }
+  }
+  return true;
+}
+
+uint8_t Colorset::packedSize(const uint8_t *buf)
+{
+  uint16_t header = buf[0] | ((uint16_t)buf[1] << 8);
+  uint8_t numColors = header & 0x7;
+  if (numColors > NUM_COLOR_SLOTS) {
+    return 0;
+  }
+  uint8_t size = PACKED_HEADER_SIZE;
+  for (uint8_t i = 0; i < NUM_COLOR_SLOTS; ++i) {
+    uint8_t kind = PACKED_KIND(header, i);
+    // the colors past the end of the set are always packed as 0
+    if (i >= numColors) {
+      if (kind) {
+        return 0;
+      }
+      continue;
+    }
+    if (kind > PACKED_RGB) {
+      return 0;
+    }
+    size += (kind == PACKED_RGB) ? 3 : 1;
+  }
+  // the last bit of the header is unused
+  if (header & 0x8000) {
+    return 0;
+  }
+  return size;
+}
@@ -130,6 +130,15 @@ public:
   // whether the colorset is currently on the first color or last color
   bool onStart() const;
   bool onEnd() const;
+
+  // pack the colorset for storage, a color from the color select menu or a
+  // shade of white only takes one byte, returns the number of bytes packed
+  uint8_t pack(uint8_t *buf) const;
+  // unpack a packed colorset, returns false if it isn't a valid colorset
+  bool unpack(const uint8_t *buf);
+  // the number of bytes a packed colorset takes, this is worked out from the
+  // header in the first two bytes and it's 0 if the header isn't valid
+  static uint8_t packedSize(const uint8_t *buf);
 private:
   // palette of colors
   RGBColor m_palette[NUM_COLOR_SLOTS];
@@ -1,8 +1,21 @@
 #include "Colortypes.h"
 
+#ifdef HELIOS_EMBEDDED
+#include <avr/pgmspace.h>
+// the tables live in flash and have to be read from there
+#define QUARTER_SQUARES(index) pgm_read_word(&quarter_squares[index])
+#define HUE_SECTOR(index) pgm_read_byte(&hue_sectors[index])
+#define RECIPROCAL(index) pgm_read_byte(&reciprocals[index])
+#else
+#define PROGMEM
+#define QUARTER_SQUARES(index) quarter_squares[index]
+#define HUE_SECTOR(index) hue_sectors[index]
+#define RECIPROCAL(index) reciprocals[index]
+#endif
+
 #if ALTERNATIVE_HSV_RGB == 1
 // global hsv to rgb algorithm selector
-hsv_to_rgb_algorithm g_hsv_rgb_alg = HSV_TO_RGB_GENERIC;
+HELIOS_LOCAL hsv_to_rgb_algorithm g_hsv_rgb_alg = HSV_TO_RGB_GENERIC;
 #endif
 
 HSVColor::HSVColor() :
@@ -175,14 +188,69 @@ RGBColor RGBColor::scaleBrightness(float scale)
 // ========================================================
 //  Below are various functions for converting hsv <-> rgb
 
+// floor(i * i / 4) for 0 to 511, the product of two bytes is the difference
+// of two of these: a * b = qs[a + b] - qs[a - b] (a >= b) which is exact
+// because a + b and a - b are both odd or both even
+#define QS_1(i) (uint16_t)(((uint32_t)(i) * (i)) / 4)
+#define QS_4(i) QS_1(i), QS_1((i) + 1), QS_1((i) + 2), QS_1((i) + 3)
+#define QS_16(i) QS_4(i), QS_4((i) + 4), QS_4((i) + 8), QS_4((i) + 12)
+#define QS_64(i) QS_16(i), QS_16((i) + 16), QS_16((i) + 32), QS_16((i) + 48)
+#define QS_256(i) QS_64(i), QS_64((i) + 64), QS_64((i) + 128), QS_64((i) + 192)
+static const uint16_t quarter_squares[512] PROGMEM = { QS_256(0), QS_256(256) };
+
+// the product of two bytes out of the quarter square table
+static inline uint16_t mul8_lut(uint8_t a, uint8_t b)
+{
+  if (a < b) {
+    uint8_t tmp = a;
+    a = b;
+    b = tmp;
+  }
+  return QUARTER_SQUARES(a + b) - QUARTER_SQUARES(a - b);
+}
+
+// which of the value (0), p (1) or the q/t ramp (2) goes into the red, green
+// and blue of each sector of the generic hue wheel, 2 bits each
+#define SECTOR(r, g, b) (uint8_t)(((r) << 4) | ((g) << 2) | (b))
+static const uint8_t hue_sectors[6] PROGMEM = {
+  SECTOR(0, 2, 1), SECTOR(2, 0, 1), SECTOR(1, 0, 2),
+  SECTOR(1, 2, 0), SECTOR(2, 1, 0), SECTOR(0, 1, 2),
+};
+
+RGBColor hsv_to_rgb_generic(const HSVColor &rhs)
+{
+#if HSV_TO_RGB_LUT == 1
+  return hsv_to_rgb_generic_lut(rhs);
+#else
+  return hsv_to_rgb_generic_math(rhs);
+#endif
+}
+
 #if ALTERNATIVE_HSV_RGB == 1
-#define SCALE8(i, scale)  (((uint16_t)i * (uint16_t)(scale)) >> 8)
+RGBColor hsv_to_rgb_rainbow(const HSVColor &rhs)
+{
+#if HSV_TO_RGB_LUT == 1
+  return hsv_to_rgb_rainbow_lut(rhs);
+#else
+  return hsv_to_rgb_rainbow_math(rhs);
+#endif
+}
+
+// the product of two bytes, either multiplied or out of the quarter square
+// table. The rainbow conversion is written once with this then inlined into
+// both versions so the table version is the same math with the same rounding
+static inline uint16_t mul8(uint8_t a, uint8_t b, bool lut)
+{
+  return lut ? mul8_lut(a, b) : (uint16_t)a * b;
+}
+
+#define SCALE8(i, scale)  (mul8((i), (scale), lut) >> 8)
 #define FIXFRAC8(N,D) (((N)*256)/(D))
 
 // Stolen from FastLED hsv to rgb full rainbox where all colours
 // are given equal weight, this makes for-example yellow larger
 // best to use this function as it is the legacy choice
-RGBColor hsv_to_rgb_rainbow(const HSVColor &rhs)
+static inline RGBColor hsv_to_rgb_rainbow_impl(const HSVColor &rhs, bool lut)
 {
   RGBColor col;
   // Yellow has a higher inherent brightness than
@@ -354,10 +422,20 @@ RGBColor hsv_to_rgb_rainbow(const HSVColor &rhs)
   col.blue = b;
   return col;
 }
+
+RGBColor hsv_to_rgb_rainbow_math(const HSVColor &rhs)
+{
+  return hsv_to_rgb_rainbow_impl(rhs, false);
+}
+
+RGBColor hsv_to_rgb_rainbow_lut(const HSVColor &rhs)
+{
+  return hsv_to_rgb_rainbow_impl(rhs, true);
+}
 #endif
 
 // generic hsv to rgb conversion nothing special
-RGBColor hsv_to_rgb_generic(const HSVColor &rhs)
+RGBColor hsv_to_rgb_generic_math(const HSVColor &rhs)
 {
   unsigned char region, remainder, p, q, t;
   RGBColor col;
@@ -400,8 +478,44 @@ RGBColor hsv_to_rgb_generic(const HSVColor &rhs)
   return col;
 }
 
-// Convert rgb to hsv with generic fast method
+// the same as the generic conversion but without the divide and with the
+// multiplies out of the quarter square table, each sector of the hue wheel
+// only uses one of q or t so only that one is worked out
+RGBColor hsv_to_rgb_generic_lut(const HSVColor &rhs)
+{
+  uint8_t val = rhs.val;
+  if (rhs.sat == 0) {
+    return RGBColor(val, val, val);
+  }
+  // step through the sectors of 43 hues instead of dividing
+  uint8_t region = 0;
+  uint8_t offset = rhs.hue;
+  while (offset >= 43) {
+    offset -= 43;
+    region++;
+  }
+  uint8_t remainder = offset * 6;
+  // q ramps down through the odd sectors and t ramps up through the even ones
+  uint8_t ramp = (region & 1) ? remainder : (uint8_t)(255 - remainder);
+  uint8_t channels[3];
+  channels[0] = val;
+  channels[1] = mul8_lut(val, 255 - rhs.sat) >> 8;
+  channels[2] = mul8_lut(val, 255 - (mul8_lut(rhs.sat, ramp) >> 8)) >> 8;
+  uint8_t sector = HUE_SECTOR(region);
+  return RGBColor(channels[sector >> 4], channels[(sector >> 2) & 0x3], channels[sector & 0x3]);
+}
+
 HSVColor rgb_to_hsv_generic(const RGBColor &rhs)
+{
+#if RGB_TO_HSV_LUT == 1
+  return rgb_to_hsv_generic_lut(rhs);
+#else
+  return rgb_to_hsv_generic_math(rhs);
+#endif
+}
+
+// Convert rgb to hsv with generic fast method
+HSVColor rgb_to_hsv_generic_math(const RGBColor &rhs)
 {
   unsigned char rgbMin, rgbMax;
   rgbMin = rhs.red < rhs.green ? (rhs.red < rhs.blue ? rhs.red : rhs.blue) : (rhs.green < rhs.blue ? rhs.green : rhs.blue);
@@ -430,3 +544,75 @@ HSVColor rgb_to_hsv_generic(const RGBColor &rhs)
   }
   return hsv;
 }
+
+// the reciprocal of each byte as 8 bits: 2^(7 + k) / i for 1 to 255 where i
+// takes k bits, so every one of them is between 128 and 255 (a power of 2
+// would be 256 so it's left at 255) and 0 is never divided by
+#define RECIP_BITS(i) ((i) >= 128 ? 8 : (i) >= 64 ? 7 : (i) >= 32 ? 6 : (i) >= 16 ? 5 : \
+                       (i) >= 8 ? 4 : (i) >= 4 ? 3 : (i) >= 2 ? 2 : 1)
+#define RECIP_DIV(i) ((1u << (7 + RECIP_BITS(i))) / ((i) ? (i) : 1))
+#define RECIP_1(i) (uint8_t)(!(i) ? 0 : (RECIP_DIV(i) > 255 ? 255 : RECIP_DIV(i)))
+#define RECIP_4(i) RECIP_1(i), RECIP_1((i) + 1), RECIP_1((i) + 2), RECIP_1((i) + 3)
+#define RECIP_16(i) RECIP_4(i), RECIP_4((i) + 4), RECIP_4((i) + 8), RECIP_4((i) + 12)
+#define RECIP_64(i) RECIP_16(i), RECIP_16((i) + 16), RECIP_16((i) + 32), RECIP_16((i) + 48)
+static const uint8_t reciprocals[256] PROGMEM = {
+  RECIP_64(0), RECIP_64(64), RECIP_64(128), RECIP_64(192)
+};
+
+// num / div out of the reciprocal table for a quotient that fits in a byte,
+// which is all that rgb to hsv divides. The estimate is never more than 2
+// too small so the remainder is used to correct it
+static inline uint8_t div8_lut(uint16_t num, uint8_t div)
+{
+  uint8_t shift = 7;
+  for (uint8_t bits = div; bits; bits >>= 1) {
+    shift++;
+  }
+  uint8_t quotient = ((uint32_t)num * RECIPROCAL(div)) >> shift;
+  uint16_t remainder = num - (uint16_t)quotient * div;
+  while (remainder >= div) {
+    remainder -= div;
+    quotient++;
+  }
+  return quotient;
+}
+
+// the same as rgb_to_hsv_generic_math but the divisions are done with the
+// reciprocal table, the hue is divided as a positive number then negated so
+// it still rounds towards 0 like the signed division
+HSVColor rgb_to_hsv_generic_lut(const RGBColor &rhs)
+{
+  unsigned char rgbMin, rgbMax;
+  rgbMin = rhs.red < rhs.green ? (rhs.red < rhs.blue ? rhs.red : rhs.blue) : (rhs.green < rhs.blue ? rhs.green : rhs.blue);
+  rgbMax = rhs.red > rhs.green ? (rhs.red > rhs.blue ? rhs.red : rhs.blue) : (rhs.green > rhs.blue ? rhs.green : rhs.blue);
+  HSVColor hsv;
+
+  hsv.val = rgbMax;
+  if (hsv.val == 0) {
+    hsv.hue = 0;
+    hsv.sat = 0;
+    return hsv;
+  }
+
+  uint8_t range = rgbMax - rgbMin;
+  hsv.sat = div8_lut(255 * (uint16_t)range, rgbMax);
+  if (hsv.sat == 0) {
+    hsv.hue = 0;
+    return hsv;
+  }
+
+  uint8_t base, up, down;
+  if (rgbMax == rhs.red) {
+    base = 0; up = rhs.green; down = rhs.blue;
+  } else if (rgbMax == rhs.green) {
+    base = 85; up = rhs.blue; down = rhs.red;
+  } else {
+    base = 171; up = rhs.red; down = rhs.green;
+  }
+  if (up >= down) {
+    hsv.hue = base + div8_lut(43 * (uint16_t)(up - down), range);
+  } else {
+    hsv.hue = base - div8_lut(43 * (uint16_t)(down - up), range);
+  }
+  return hsv;
+}
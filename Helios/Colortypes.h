@@ -15,7 +15,7 @@ enum hsv_to_rgb_algorithm : uint8_t
 
 // global hsv to rgb algorithm selector, switch this to control
 // all hsv to rgb conversions
-extern hsv_to_rgb_algorithm g_hsv_rgb_alg;
+extern HELIOS_LOCAL hsv_to_rgb_algorithm g_hsv_rgb_alg;
 #endif
 
 class ByteStream;
@@ -102,7 +102,22 @@ RGBColor hsv_to_rgb_rainbow(const HSVColor &rhs);
 // generic hsv to rgb conversion nothing special
 RGBColor hsv_to_rgb_generic(const HSVColor &rhs);
 
+// the two ways each of the above can be done, HSV_TO_RGB_LUT picks which
+// one is used but they always give exactly the same colors. The rainbow
+// conversion is only built with ALTERNATIVE_HSV_RGB
+#if ALTERNATIVE_HSV_RGB == 1
+RGBColor hsv_to_rgb_rainbow_math(const HSVColor &rhs);
+RGBColor hsv_to_rgb_rainbow_lut(const HSVColor &rhs);
+#endif
+RGBColor hsv_to_rgb_generic_math(const HSVColor &rhs);
+RGBColor hsv_to_rgb_generic_lut(const HSVColor &rhs);
+
 // Convert rgb to hsv with generic fast method
 HSVColor rgb_to_hsv_generic(const RGBColor &rhs);
 
+// the two ways the above can be done, RGB_TO_HSV_LUT picks which one is used
+// but they always give exactly the same colors
+HSVColor rgb_to_hsv_generic_math(const RGBColor &rhs);
+HSVColor rgb_to_hsv_generic_lut(const RGBColor &rhs);
+
 #endif
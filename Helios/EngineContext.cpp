@@ -0,0 +1,170 @@
+#include "EngineContext.h"
+
+#ifdef HELIOS_CLI
+
+#include <string.h>
+#include <utility>
+
+#include "TimeControl.h"
+#include "Storage.h"
+#include "Button.h"
+#include "Helios.h"
+#include "Led.h"
+
+// swap one piece of engine state with the copy held in the context, the
+// private enums of Helios are held as plain bytes so cast across the swap
+template <typename T, typename U>
+static void swap_state(T &engine, U &held)
+{
+  T tmp = engine;
+  engine = (T)held;
+  held = (U)tmp;
+}
+
+EngineContext::EngineContext() :
+  m_helios(),
+  m_led(),
+  m_time(),
+  m_button(),
+  m_storageState(),
+#if ALTERNATIVE_HSV_RGB == 1
+  m_hsvRgbAlg(HSV_TO_RGB_GENERIC),
+#endif
+  m_storage()
+{
+  // same defaults as the static members of the engine
+  m_led.brightness = DEFAULT_BRIGHTNESS;
+  m_led.drawnLayers = 0;
+  m_led.ledColor = RGB_OFF;
+  m_led.realColor = RGB_OFF;
+  m_led.shownLayer = LED_LAYER_PATTERN;
+  // contexts never run in realtime, there is no point in sleeping a thread
+  m_time.enableTimestep = false;
+  // storage goes to the image held by this context instead of the file
+  m_storageState.enableStorage = true;
+  m_storageState.storageImage = m_storage;
+  m_storageState.storageFile = STORAGE_FILENAME;
+  m_storageState.mappedImage = nullptr;
+  // nothing is staged to be saved yet
+  m_storageState.pendingSlot = STORAGE_KEY_NONE;
+  m_storageState.writeKey = STORAGE_KEY_NONE;
+#if STORAGE_WEAR_LEVELING == 1
+  m_storageState.moveKey = STORAGE_KEY_NONE;
+#endif
+  // an empty storage image is invalid so the engine loads its defaults
+  memset(m_storage, 0, sizeof(m_storage));
+}
+
+EngineContext::~EngineContext()
+{
+  // a storage file that was mapped by this engine is unmapped with it
+  if (m_storageState.mappedImage) {
+    exchange();
+    Storage::cleanup();
+    exchange();
+  }
+}
+
+void EngineContext::setStorageFile(const char *filename)
+{
+  m_storageState.storageFile = filename;
+  m_storageState.storageImage = nullptr;
+}
+
+bool EngineContext::init()
+{
+  exchange();
+  bool result = Helios::init();
+  exchange();
+  return result;
+}
+
+void EngineContext::tick(uint32_t numTicks)
+{
+  exchange();
+  for (uint32_t i = 0; i < numTicks && Helios::keep_going(); ++i) {
+    Helios::tick();
+  }
+  exchange();
+}
+
+void EngineContext::exchange()
+{
+  // Helios
+  swap_state(Helios::cur_state, m_helios.cur_state);
+  swap_state(Helios::global_flags, m_helios.global_flags);
+  std::swap(Helios::menu_selection, m_helios.menu_selection);
+  std::swap(Helios::cur_mode, m_helios.cur_mode);
+  std::swap(Helios::selected_slot, m_helios.selected_slot);
+  std::swap(Helios::selected_base_quad, m_helios.selected_base_quad);
+  std::swap(Helios::selected_hue, m_helios.selected_hue);
+  std::swap(Helios::selected_sat, m_helios.selected_sat);
+  std::swap(Helios::selected_val, m_helios.selected_val);
+  std::swap(Helios::pat, m_helios.pat);
+  std::swap(Helios::keepgoing, m_helios.keepgoing);
+  std::swap(Helios::sleeping, m_helios.sleeping);
+  // Led
+  std::swap(Led::m_brightness, m_led.brightness);
+  std::swap(Led::m_layers, m_led.layers);
+  std::swap(Led::m_drawnLayers, m_led.drawnLayers);
+  std::swap(Led::m_ledColor, m_led.ledColor);
+  std::swap(Led::m_realColor, m_led.realColor);
+  std::swap(Led::m_shownLayer, m_led.shownLayer);
+#if LED_OUTPUT_LUT == 1
+  std::swap(Led::m_outputTable, m_led.outputTable);
+#endif
+  // Time
+  std::swap(Time::m_curTick, m_time.curTick);
+  std::swap(Time::m_prevTime, m_time.prevTime);
+  std::swap(Time::m_enableTimestep, m_time.enableTimestep);
+  std::swap(Time::m_deadlines, m_time.deadlines);
+  std::swap(Time::m_deadlineFlags, m_time.deadlineFlags);
+  // Button
+  std::swap(Button::m_pressTime, m_button.pressTime);
+  std::swap(Button::m_releaseTime, m_button.releaseTime);
+  std::swap(Button::m_holdDuration, m_button.holdDuration);
+  std::swap(Button::m_releaseDuration, m_button.releaseDuration);
+  std::swap(Button::m_releaseCount, m_button.releaseCount);
+  std::swap(Button::m_buttonState, m_button.buttonState);
+  std::swap(Button::m_newPress, m_button.newPress);
+  std::swap(Button::m_newRelease, m_button.newRelease);
+  std::swap(Button::m_isPressed, m_button.isPressed);
+  std::swap(Button::m_shortClick, m_button.shortClick);
+  std::swap(Button::m_longClick, m_button.longClick);
+  std::swap(Button::m_holdClick, m_button.holdClick);
+  std::swap(Button::m_inputQueue, m_button.inputQueue);
+  std::swap(Button::m_pinState, m_button.pinState);
+  std::swap(Button::m_enableWake, m_button.enableWake);
+  // Storage
+  std::swap(Storage::m_enableStorage, m_storageState.enableStorage);
+  std::swap(Storage::m_storageImage, m_storageState.storageImage);
+  std::swap(Storage::m_storageFile, m_storageState.storageFile);
+  std::swap(Storage::m_mappedImage, m_storageState.mappedImage);
+  std::swap(Storage::m_pendingData, m_storageState.pendingData);
+  std::swap(Storage::m_pendingSlot, m_storageState.pendingSlot);
+  std::swap(Storage::m_pendingSize, m_storageState.pendingSize);
+  std::swap(Storage::m_configDirty, m_storageState.configDirty);
+  std::swap(Storage::m_defaultSlots, m_storageState.defaultSlots);
+  std::swap(Storage::m_writeKey, m_storageState.writeKey);
+  std::swap(Storage::m_writeStep, m_storageState.writeStep);
+  std::swap(Storage::m_writeTries, m_storageState.writeTries);
+  std::swap(Storage::m_writeCrc, m_storageState.writeCrc);
+  std::swap(Storage::m_configCache, m_storageState.configCache);
+#if STORAGE_MODE_CACHE == 1
+  std::swap(Storage::m_modeCache, m_storageState.modeCache);
+  std::swap(Storage::m_cacheValid, m_storageState.cacheValid);
+#endif
+#if STORAGE_WEAR_LEVELING == 1
+  std::swap(Storage::m_logIndex, m_storageState.logIndex);
+  std::swap(Storage::m_logHead, m_storageState.logHead);
+  std::swap(Storage::m_logSeq, m_storageState.logSeq);
+  std::swap(Storage::m_moveKey, m_storageState.moveKey);
+  std::swap(Storage::m_moveSize, m_storageState.moveSize);
+  std::swap(Storage::m_clearKey, m_storageState.clearKey);
+#endif
+#if ALTERNATIVE_HSV_RGB == 1
+  std::swap(g_hsv_rgb_alg, m_hsvRgbAlg);
+#endif
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef ENGINE_CONTEXT_H
+#define ENGINE_CONTEXT_H
+
+#include "HeliosConfig.h"
+
+// The engine context only exists on the host builds, the embedded build only
+// has a single engine which lives directly in the static members of Helios
+#ifdef HELIOS_CLI
+
+#include <inttypes.h>
+#include <deque>
+
+#include "TimeControl.h"
+#include "Storage.h"
+#include "Colortypes.h"
+#include "Pattern.h"
+#include "Led.h"
+
+// An engine context holds the complete state of one Helios engine. The engine
+// itself is still the static Helios, Led, Time, Button and Storage classes but
+// on host builds their state is thread local (see HELIOS_LOCAL), so a context
+// can be exchanged into any thread, stepped, then exchanged back out again.
+// This allows one process to simulate any number of independent devices.
+class EngineContext
+{
+public:
+  EngineContext();
+  ~EngineContext();
+
+  // the context points into itself for storage so it can't be copied
+  EngineContext(const EngineContext &) = delete;
+  EngineContext &operator=(const EngineContext &) = delete;
+
+  // initialize a fresh engine inside of this context
+  bool init();
+
+  // exchange this context into the engine of the calling thread and run some
+  // ticks, the engine state of the calling thread is left untouched after
+  void tick(uint32_t numTicks = 1);
+
+  // swap the state held by this context with the engine state of the calling
+  // thread, calling this a second time will swap the original state back. So
+  // the static apis can be used in between to inspect or drive this engine
+  void exchange();
+
+  // whether the engine in this context is still running
+  bool keepGoing() const { return m_helios.keepgoing; }
+
+  // the current color of the led of the engine in this context
+  RGBColor ledColor() const { return m_led.ledColor; }
+
+  // the storage image of this engine, EEPROM_SIZE bytes
+  uint8_t *storage() { return m_storage; }
+
+  // back the storage of this engine with a file instead of the image held by
+  // the context, this must be done before init because that is when the file
+  // is mapped, the file is flushed and unmapped when the context is destroyed
+  void setStorageFile(const char *filename);
+
+private:
+  // the state of the Helios class
+  struct {
+    // the state and flags are private enums of Helios, they are held as bytes
+    uint8_t cur_state;
+    uint8_t global_flags;
+    uint8_t menu_selection;
+    uint8_t cur_mode;
+    uint8_t selected_slot;
+    uint8_t selected_base_quad;
+    uint8_t selected_hue;
+    uint8_t selected_sat;
+    uint8_t selected_val;
+    Pattern pat;
+    bool keepgoing;
+    bool sleeping;
+  } m_helios;
+
+  // the state of the Led class
+  struct {
+    uint8_t brightness;
+    RGBColor layers[LED_LAYER_COUNT];
+    uint8_t drawnLayers;
+    RGBColor ledColor;
+    RGBColor realColor;
+    LedLayer shownLayer;
+#if LED_OUTPUT_LUT == 1
+    uint8_t outputTable[256];
+#endif
+  } m_led;
+
+  // the state of the Time class
+  struct {
+    uint32_t curTick;
+    uint32_t prevTime;
+    bool enableTimestep;
+    uint32_t deadlines[TIME_DEADLINE_COUNT];
+    uint8_t deadlineFlags;
+  } m_time;
+
+  // the state of the Button class
+  struct {
+    uint32_t pressTime;
+    uint32_t releaseTime;
+    uint32_t holdDuration;
+    uint32_t releaseDuration;
+    uint8_t releaseCount;
+    bool buttonState;
+    bool newPress;
+    bool newRelease;
+    bool isPressed;
+    bool shortClick;
+    bool longClick;
+    bool holdClick;
+    std::deque<char> inputQueue;
+    bool pinState;
+    bool enableWake;
+  } m_button;
+
+  // the state of the Storage class
+  struct {
+    bool enableStorage;
+    uint8_t *storageImage;
+    const char *storageFile;
+    uint8_t *mappedImage;
+    uint8_t pendingData[SLOT_DATA_SIZE];
+    uint8_t pendingSlot;
+    uint8_t pendingSize;
+    bool configDirty;
+    uint8_t defaultSlots;
+    uint8_t writeKey;
+    uint8_t writeStep;
+    uint8_t writeTries;
+    uint8_t writeCrc;
+    uint8_t configCache[STORAGE_CONFIG_SIZE];
+#if STORAGE_MODE_CACHE == 1
+    uint8_t modeCache[STORAGE_MODE_CACHE_SIZE];
+    uint8_t cacheValid;
+#endif
+#if STORAGE_WEAR_LEVELING == 1
+    uint8_t logIndex[NUM_LOG_KEYS];
+    uint8_t logHead;
+    uint8_t logSeq;
+    uint8_t moveKey;
+    uint8_t moveSize;
+    bool clearKey;
+#endif
+  } m_storageState;
+
+#if ALTERNATIVE_HSV_RGB == 1
+  // the global hsv to rgb algorithm is engine state too
+  hsv_to_rgb_algorithm m_hsvRgbAlg;
+#endif
+
+  // the storage image that backs the storage of this engine
+  uint8_t m_storage[EEPROM_SIZE];
+};
+
+#endif
+
+#endif
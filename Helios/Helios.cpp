@@ -28,20 +28,20 @@
 // the number of menus in quadrant selection
 #define NUM_MENUS_QUADRANT 7
 
-Helios::State Helios::cur_state;
-Helios::Flags Helios::global_flags;
-uint8_t Helios::menu_selection;
-uint8_t Helios::cur_mode;
-uint8_t Helios::selected_slot;
-uint8_t Helios::selected_base_quad;
-uint8_t Helios::selected_hue;
-uint8_t Helios::selected_sat;
-uint8_t Helios::selected_val;
-Pattern Helios::pat;
-bool Helios::keepgoing;
+HELIOS_LOCAL Helios::State Helios::cur_state;
+HELIOS_LOCAL Helios::Flags Helios::global_flags;
+HELIOS_LOCAL uint8_t Helios::menu_selection;
+HELIOS_LOCAL uint8_t Helios::cur_mode;
+HELIOS_LOCAL uint8_t Helios::selected_slot;
+HELIOS_LOCAL uint8_t Helios::selected_base_quad;
+HELIOS_LOCAL uint8_t Helios::selected_hue;
+HELIOS_LOCAL uint8_t Helios::selected_sat;
+HELIOS_LOCAL uint8_t Helios::selected_val;
+HELIOS_LOCAL Pattern Helios::pat;
+HELIOS_LOCAL bool Helios::keepgoing;
 
 #ifdef HELIOS_CLI
-bool Helios::sleeping;
+HELIOS_LOCAL bool Helios::sleeping;
 #endif
 
 volatile char helios_version[] = HELIOS_VERSION_STR;
@@ -78,6 +78,11 @@ bool Helios::init_components()
   if (!Time::init()) {
     return false;
   }
+#ifdef HELIOS_CLI
+  // the engine skips ahead to the blink timer deadline of the pattern it
+  // plays when it can, no other pattern reports a deadline
+  pat.reportDeadline(TIME_DEADLINE_BLINK);
+#endif
   if (!Led::init()) {
     return false;
   }
@@ -110,6 +115,10 @@ bool Helios::init_components()
 
 void Helios::tick()
 {
+  // write the next byte of anything that was saved, the saves are staged in
+  // ram so this never waits on the eeprom
+  Storage::service();
+
   // sample the button and re-calculate all button globals
   // the button globals should not change anywhere else
   Button::update();
@@ -127,11 +136,56 @@ void Helios::tick()
   Time::tickClock();
 }
 
+#ifdef HELIOS_CLI
+uint32_t Helios::fast_forward(uint32_t max_ticks)
+{
+  uint32_t idle = max_ticks;
+  switch (cur_state) {
+  case STATE_MODES:
+    // the mode only plays when the button is released and it's unlocked,
+    // otherwise the menus or lock might change the led any tick
+    if (has_flags(FLAG_LOCKED) || !Button::releaseCount() || Button::isPressed()) {
+      return 0;
+    }
+    // and a save is written a byte per tick so those ticks all have to run
+    if (Storage::busy()) {
+      return 0;
+    }
+    // then nothing changes till the next timer deadline, the pattern only
+    // changes when its blink timer hits and a blend only steps when the
+    // pattern blinks on so that is covered by this too
+    if (Time::nextDeadline() < idle) {
+      idle = Time::nextDeadline();
+    }
+    break;
+  case STATE_SLEEP:
+    // nothing changes in sleep till the button wakes it
+    if (Storage::busy()) {
+      return 0;
+    }
+    break;
+  default:
+    return 0;
+  }
+  // the waits are popped the same as if each of those ticks had run
+  uint32_t skipped = Button::skipWaits(idle);
+  Time::skipTicks(skipped);
+  return skipped;
+}
+#endif
+
 void Helios::enter_sleep()
 {
 #ifdef HELIOS_EMBEDDED
   // clear the led colors
   Led::clear();
+  // finish writing anything still staged for the eeprom before sleeping, this
+  // is the only time a save waits on the eeprom
+  Storage::flush();
+#if STORAGE_MODE_CACHE == 1
+  // the cache stays in ram so waking up doesn't have to reload storage
+  Storage::suspend();
+#endif
   // Set all pins to input
   DDRB = 0x00;
   // Disable pull-ups on all pins
@@ -188,10 +242,10 @@ void Helios::load_cur_mode()
 {
   // read pattern from storage at cur mode index
   if (!Storage::read_pattern(cur_mode, pat)) {
-    // and just initialize default if it cannot be read
-    Patterns::make_default(cur_mode, pat);
-    // try to write it out because storage was corrupt
-    Storage::write_pattern(cur_mode, pat);
+    // and just initialize default if it cannot be read, the default isn't
+    // written out till the user actually changes the mode and saves it. The
+    // default follows the slot so that it moves along when modes are shifted
+    Patterns::make_default(Storage::mode_slot(cur_mode), pat);
   }
   // then re-initialize the pattern
   pat.init();
@@ -206,24 +260,20 @@ void Helios::load_global_flags()
 {
   // read the global flags from index 0 config
   global_flags = (Flags)Storage::read_global_flags();
+  // Check if flags are valid (FLAGS_INVALID is inverse mask of valid flags)
+  if (has_any_flags(FLAGS_INVALID)) {
+    // the storage was likely uninitialized or corrupt so use the defaults,
+    // they aren't written out till the user actually changes something
+    global_flags = FLAG_NONE;
+  }
   if (has_flags(FLAG_CONJURE)) {
     // if conjure is enabled then load the current mode index from storage
-    cur_mode = Storage::read_current_mode();
+    cur_mode = Storage::read_current_mode() % NUM_MODE_SLOTS;
   }
   // read the global brightness from index 2 config
   uint8_t saved_brightness = Storage::read_brightness();
-  // Check if flags are valid (FLAGS_INVALID is inverse mask of valid flags)
-  // and brightness is set in storage
-  bool is_valid = !has_any_flags(FLAGS_INVALID) && saved_brightness > 0;
-  if (is_valid) {
-    Led::setBrightness(saved_brightness);
-  }
-
-  if (!is_valid) {
-    // if the brightness was 0 and the flags are invalid then the storage was likely
-    // uninitialized or corrupt so write out the defaults
-    factory_reset();
-  }
+  // a brightness of 0 was never set in storage so use the default
+  Led::setBrightness(saved_brightness ? saved_brightness : DEFAULT_BRIGHTNESS);
 }
 
 void Helios::save_global_flags()
@@ -251,7 +301,7 @@ void Helios::handle_state()
     }
     // but as long as it's held past the sleep time it just turns off the led
     if (Button::isPressed()) {
-      Led::clear();
+      Led::clear(LED_LAYER_MENU);
       return;
     }
   }
@@ -334,7 +384,7 @@ void Helios::handle_state_modes()
 
   // flash red briefly when locked and short clicked
   if (has_flags(FLAG_LOCKED) && !heldPast) {
-    Led::set(RGB_RED_BRI_LOW);
+    Led::set(RGB_RED_BRI_LOW, LED_LAYER_MENU);
   }
   // if the button is held for at least 1 second
   if (Button::isPressed() && heldPast) {
@@ -342,27 +392,27 @@ void Helios::handle_state_modes()
     if (hasReleased) {
       switch (magnitude) {
         default:
-        case 0: Led::clear(); break;                                     // Turn off
-        case 1: Led::set(0, 0x3c, 0x31); break;                          // Color Selection
-        case 2: Led::set(0x3c, 0, 0x0e); break;                          // Pattern Selection
-        case 3: Led::set(0x3c, 0x1c, 0); break;                          // Conjure Mode
-        case 4: Led::set(0x3c, 0x3c, 0x3c); break;                       // Shift Mode
-        case 5: Led::set(HSVColor(Time::getCurtime(), 255, 100)); break; // Randomizer
+        case 0: Led::clear(LED_LAYER_MENU); break;                                       // Turn off
+        case 1: Led::set(0, 0x3c, 0x31, LED_LAYER_MENU); break;                          // Color Selection
+        case 2: Led::set(0x3c, 0, 0x0e, LED_LAYER_MENU); break;                          // Pattern Selection
+        case 3: Led::set(0x3c, 0x1c, 0, LED_LAYER_MENU); break;                          // Conjure Mode
+        case 4: Led::set(0x3c, 0x3c, 0x3c, LED_LAYER_MENU); break;                       // Shift Mode
+        case 5: Led::set(HSVColor(Time::getCurtime(), 255, 100), LED_LAYER_MENU); break; // Randomizer
       }
     } else {
       if (has_flags(FLAG_LOCKED)) {
         switch (magnitude) {
           default:
-          case 0: Led::clear(); break;
-          case TIME_TILL_GLOW_LOCK_UNLOCK: Led::set(0x3c, 0, 0); break; // Exit
+          case 0: Led::clear(LED_LAYER_MENU); break;
+          case TIME_TILL_GLOW_LOCK_UNLOCK: Led::set(0x3c, 0, 0, LED_LAYER_MENU); break; // Exit
         }
       } else {
         switch (magnitude) {
           default:
-          case 0: Led::clear(); break;         // nothing
-          case 1: Led::set(0x3c, 0, 0); break; // Enter Glow Lock
-          case 2: Led::set(0, 0x3c, 0); break; // Global Brightness
-          case 3: Led::set(0, 0, 0x3c); break; // Master Reset
+          case 0: Led::clear(LED_LAYER_MENU); break;           // nothing
+          case 1: Led::set(0x3c, 0, 0, LED_LAYER_MENU); break; // Enter Glow Lock
+          case 2: Led::set(0, 0x3c, 0, LED_LAYER_MENU); break; // Global Brightness
+          case 3: Led::set(0, 0, 0x3c, LED_LAYER_MENU); break; // Master Reset
         }
       }
     }
@@ -401,7 +451,7 @@ void Helios::handle_off_menu(uint8_t mag, bool past)
   switch (mag) {
     case 1:  // red lock
       cur_state = STATE_TOGGLE_LOCK;
-      Led::clear();
+      Led::clear(LED_LAYER_MENU);
       return; // RETURN HERE
     case 2:  // green global brightness
       cur_state = STATE_SET_GLOBAL_BRIGHTNESS;
@@ -444,7 +494,7 @@ void Helios::handle_on_menu(uint8_t mag, bool past)
       break;
     case 3:  // conjure mode
       cur_state = STATE_TOGGLE_CONJURE;
-      Led::clear();
+      Led::clear(LED_LAYER_MENU);
       break;
     case 4:  // shift mode down
       cur_state = STATE_SHIFT_MODE;
@@ -518,14 +568,14 @@ void Helios::handle_state_col_select_slot(ColorSelectOption &out_option)
   if (num_cols < NUM_COLOR_SLOTS && menu_selection == num_cols) {
     // add color
     out_option = SELECTED_ADD;
-    Led::strobe(100, 100, RGB_WHITE_BRI_LOW, RGB_OFF);
+    Led::strobe(100, 100, RGB_WHITE_BRI_LOW, RGB_OFF, LED_LAYER_MENU);
     if (long_click) {
       selected_slot = menu_selection;
     }
   } else if (menu_selection == num_cols + 1 || (num_cols == NUM_COLOR_SLOTS && menu_selection == num_cols)) {
     // exit
     out_option = SELECTED_EXIT;
-    Led::strobe(60, 40, RGB_RED_BRI_LOW, RGB_OFF);
+    Led::strobe(60, 40, RGB_RED_BRI_LOW, RGB_OFF, LED_LAYER_MENU);
     if (long_click) {
 #if ALTERNATIVE_HSV_RGB == 1
       // restore hsv to rgb algorithm type, done color selection
@@ -541,13 +591,13 @@ void Helios::handle_state_col_select_slot(ColorSelectOption &out_option)
     // render current selection
     RGBColor col = set.get(selected_slot);
     if (col.empty()) {
-      Led::strobe(1, 30, RGB_OFF, RGB_WHITE_BRI_LOW);
+      Led::strobe(1, 30, RGB_OFF, RGB_WHITE_BRI_LOW, LED_LAYER_MENU);
     } else {
-      Led::strobe(3, 30, RGB_OFF, col);
+      Led::strobe(3, 30, RGB_OFF, col, LED_LAYER_MENU);
     }
     if (Button::holdPressing()) {
       // flash red
-      Led::strobe(150, 150, RGB_RED_BRI_LOW, col);
+      Led::strobe(150, 150, RGB_RED_BRI_LOW, col, LED_LAYER_SELECTION);
     }
     if (Button::onHoldClick()){
       set.removeColor(selected_slot);
@@ -633,7 +683,7 @@ void Helios::handle_state_col_select_quadrant()
       off_dur = 500;
       break;
   }
-  Led::strobe(on_dur, off_dur, col1, col2);
+  Led::strobe(on_dur, off_dur, col1, col2, LED_LAYER_MENU);
   // show a white flash for the first two menus
   if (menu_selection <= 1) {
     show_selection(RGB_WHITE_BRI_LOW);
@@ -679,10 +729,10 @@ void Helios::handle_state_col_select_hue_sat_val()
       break;
   }
   // render current selection
-  Led::set(HSVColor(selected_hue, selected_sat, selected_val));
+  Led::set(HSVColor(selected_hue, selected_sat, selected_val), LED_LAYER_MENU);
   // show the long selection flash
   if (Button::holdPressing()) {
-    Led::strobe(150, 150, RGB_CORAL_ORANGE_SAT_LOWEST, Led::get());
+    Led::strobe(150, 150, RGB_CORAL_ORANGE_SAT_LOWEST, Led::get(), LED_LAYER_SELECTION);
   }
   // check to see if we are holding to save and skip
   if (saveAndFinish) {
@@ -732,9 +782,9 @@ void Helios::handle_state_set_defaults()
   }
   // show low white for exit or red for select
   if (menu_selection) {
-    Led::strobe(80, 20, RGB_RED_BRI_LOW, RGB_OFF);
+    Led::strobe(80, 20, RGB_RED_BRI_LOW, RGB_OFF, LED_LAYER_MENU);
   } else {
-    Led::strobe(20, 10, RGB_WHITE_BRI_LOWEST, RGB_OFF);
+    Led::strobe(20, 10, RGB_WHITE_BRI_LOWEST, RGB_OFF, LED_LAYER_MENU);
   }
   // when the user long clicks a selection
   if (Button::onLongClick()) {
@@ -749,10 +799,8 @@ void Helios::handle_state_set_defaults()
 
 void Helios::factory_reset()
 {
-  for (uint8_t i = 0; i < NUM_MODE_SLOTS; ++i) {
-    Patterns::make_default(i, pat);
-    Storage::write_pattern(i, pat);
-  }
+  // the default patterns are written out in the background a slot at a time
+  Storage::reset_patterns();
   // Reset global brightness to default
   Led::setBrightness(DEFAULT_BRIGHTNESS);
   Storage::write_brightness(DEFAULT_BRIGHTNESS);
@@ -791,7 +839,7 @@ void Helios::handle_state_set_global_brightness()
       brightness = BRIGHTNESS_LOWEST;
       break;
   }
-  Led::set(0, col, 0);
+  Led::set(0, col, 0, LED_LAYER_MENU);
   // when the user long clicks a selection
   if (Button::onLongClick()) {
     // set the brightness based on the selection
@@ -805,12 +853,11 @@ void Helios::handle_state_set_global_brightness()
 void Helios::handle_state_shift_mode()
 {
   uint8_t new_mode = (cur_mode > 0) ? (uint8_t)(cur_mode - 1) : (uint8_t)(NUM_MODE_SLOTS - 1);
-  // copy the storage from the new position into our current position
-  Storage::copy_slot(new_mode, cur_mode);
+  // swap the slots of the two positions in the slot table, the patterns
+  // themselves stay where they are in storage
+  Storage::swap_modes(new_mode, cur_mode);
   // point at the new position
   cur_mode = new_mode;
-  // write out the current mode to the newly updated position
-  save_cur_mode();
   cur_state = STATE_MODES;
 }
 
@@ -843,5 +890,5 @@ void Helios::show_selection(RGBColor color)
   if (holdDur < SHORT_CLICK_THRESHOLD || holdDur >= HOLD_CLICK_START) {
     return;
   }
-  Led::set(color);
+  Led::set(color, LED_LAYER_SELECTION);
 }
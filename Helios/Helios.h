@@ -26,6 +26,12 @@ public:
 #ifdef HELIOS_CLI
   static bool is_asleep() { return sleeping; }
   static Pattern &cur_pattern() { return pat; }
+
+  // skip up to some number of ticks in which nothing can change, this only
+  // happens when the pattern is just waiting on a timer or helios is asleep
+  // and the only inputs queued for those ticks are waits. Returns the number
+  // of ticks that were skipped, the led is the same for all of those ticks
+  static uint32_t fast_forward(uint32_t max_ticks);
 #endif
 
   enum Flags : uint8_t {
@@ -106,23 +112,26 @@ private:
   };
 
   // the current state of the system
-  static State cur_state;
+  static HELIOS_LOCAL State cur_state;
   // global flags for the entire system
-  static Flags global_flags;
-  static uint8_t menu_selection;
-  static uint8_t cur_mode;
+  static HELIOS_LOCAL Flags global_flags;
+  static HELIOS_LOCAL uint8_t menu_selection;
+  static HELIOS_LOCAL uint8_t cur_mode;
   // the quadrant that was selected in color select
-  static uint8_t selected_slot;
-  static uint8_t selected_base_quad;
-  static uint8_t selected_hue;
-  static uint8_t selected_sat;
-  static uint8_t selected_val;
+  static HELIOS_LOCAL uint8_t selected_slot;
+  static HELIOS_LOCAL uint8_t selected_base_quad;
+  static HELIOS_LOCAL uint8_t selected_hue;
+  static HELIOS_LOCAL uint8_t selected_sat;
+  static HELIOS_LOCAL uint8_t selected_val;
   static PatternArgs default_args[6];
   static Colorset default_colorsets[6];
-  static Pattern pat;
-  static bool keepgoing;
+  static HELIOS_LOCAL Pattern pat;
+  static HELIOS_LOCAL bool keepgoing;
 
 #ifdef HELIOS_CLI
-  static bool sleeping;
+  static HELIOS_LOCAL bool sleeping;
+
+  // the engine context swaps this state in and out
+  friend class EngineContext;
 #endif
 };
@@ -38,6 +38,18 @@
 #define EXPAND_AND_QUOTE(str) ADD_QUOTES(str)
 #define HELIOS_VERSION_STR    EXPAND_AND_QUOTE(HELIOS_VERSION_NUMBER)
 
+// Engine Local Storage
+//
+// All of the engine state lives in static members, on the host builds
+// that state is thread local so that any number of independent engines
+// can be swapped in and stepped from a pool of threads (see EngineContext)
+// but the embedded build only ever has one engine so it stays plain static
+#ifdef HELIOS_CLI
+#define HELIOS_LOCAL thread_local
+#else
+#define HELIOS_LOCAL
+#endif
+
 // Short Click Threshold
 //
 // The length of time in milliseconds for a click to
@@ -71,8 +83,11 @@
 
 // Mode Slots
 //
-// The number of modes on the device
+// The number of modes on the device, storage has room for up to 8 and
+// any modes past the 6 defaults start out as a repeat of them
+#ifndef NUM_MODE_SLOTS
 #define NUM_MODE_SLOTS 6
+#endif
 
 // Number of Global Brightness Options
 //
@@ -122,8 +137,67 @@
 //
 // This enabled the alternative HSV to RGB algorithm to be used in the
 // color selection menu and provide a slightly different range of colors
+#ifndef ALTERNATIVE_HSV_RGB
 #define ALTERNATIVE_HSV_RGB 0
+#endif
+
 
+// Table Driven HSV to RGB
+//
+// Do the hsv to rgb conversions with tables instead of math, the colors are
+// exactly the same either way. The attiny85 has no hardware multiply so the
+// tables make each conversion a lot faster there but they take about 1kb of
+// flash, so they are only on by default for the cli
+#ifndef HSV_TO_RGB_LUT
+#ifdef HELIOS_CLI
+#define HSV_TO_RGB_LUT 1
+#else
+#define HSV_TO_RGB_LUT 0
+#endif
+#endif
+
+// Table Driven RGB to HSV
+//
+// Do the divisions of the rgb to hsv conversion with a table of reciprocals
+// instead, the colors are exactly the same either way. The attiny85 divides
+// in software so this is a lot faster there and the table is only 256 bytes
+// of flash, which is only linked in if something converts rgb to hsv. A host
+// cpu divides in hardware and the table lookup is slower there (see
+// tests/colorbench), so it is only on by default for the device
+#ifndef RGB_TO_HSV_LUT
+#ifdef HELIOS_CLI
+#define RGB_TO_HSV_LUT 0
+#else
+#define RGB_TO_HSV_LUT 1
+#endif
+#endif
+
+
+// Gamma Correction
+//
+// Run the led colors through a gamma curve of 2.2 before they go out to the
+// pwm, the brightness steps of the pwm are linear but the eye is far more
+// sensitive to the low end so this spreads the colors out more evenly
+#ifndef LED_GAMMA
+#define LED_GAMMA 0
+#endif
+
+// Led Output Table
+//
+// The global brightness and the gamma curve are applied to each channel of
+// the led color once per tick in Led::update, with this they are folded into
+// one table that is rebuilt whenever the brightness changes so each channel
+// is just a lookup. The table takes 256 bytes of ram which is half of the ram
+// on the attiny85, more than the stack has left, and it can't go in flash
+// because any brightness can be set. Without it each channel is a gamma
+// lookup and one 8 bit multiply, only 3 a tick, so it is only on for the cli
+#ifndef LED_OUTPUT_LUT
+#ifdef HELIOS_CLI
+#define LED_OUTPUT_LUT 1
+#else
+#define LED_OUTPUT_LUT 0
+#endif
+#endif
 
 // Pre-defined saturation values
 #define HSV_SAT_HIGH      255
@@ -153,39 +227,105 @@
 // Storage Size
 //
 // The total size of storage where modes and global settings are saved.
-// The EEPROM on attiny85 is 512 bytes, but due to limitations on flash
-// only the lower half of the eeprom is being used
+// The EEPROM on attiny85 is 512 bytes, the modes and settings have their
+// home in the lower half and the upper half is the storage log below
 #define STORAGE_SIZE 256
 
-// Colorset Size
-//
-// the colorset is just an array of colors but it also has a num colors val
-#define COLORSET_SIZE ((sizeof(RGBColor) * NUM_COLOR_SLOTS) + 1)
-
 // Pattern Args Size
 //
 // There is currently 6 args for a pattern: on, off, gap, dash, group, blend
 // Each takes up 1 byte currently
 #define PAT_ARGS_SIZE (sizeof(PatternArgs))
 
-// Pattern Size
+// Pattern Format Version
+//
+// Every saved pattern starts with this, it changes whenever the layout of a
+// saved pattern changes so that a save of another layout is never misread
+#define PATTERN_FORMAT_VERSION 1
+
+// Pattern Header Size
+//
+// The format version and the packed colorset header, this is enough of a
+// saved pattern to work out how many bytes the rest of it takes
+#define PATTERN_HEADER_SIZE 3
+
+// Packed Colorset Size
 //
-// The actual pattern storage size is the size of the colorset + params + 1 pat flags
-#define PATTERN_SIZE (COLORSET_SIZE + PAT_ARGS_SIZE + 1)
+// In storage the colorset is packed behind a 2 byte header, a color from the
+// color select menu or a shade of white takes 1 byte and any other takes 3
+// so this is the most a packed colorset can take
+#define PACKED_COLORSET_SIZE ((sizeof(RGBColor) * NUM_COLOR_SLOTS) + 2)
+
+// Slot Data Size
+//
+// The most a packed pattern can take: the version + the packed colorset + params + 1 pat flags
+#define SLOT_DATA_SIZE (1 + PACKED_COLORSET_SIZE + PAT_ARGS_SIZE + 1)
 
 // Slot Size
 //
-// the slot stores the pattern + 1 byte CRC
-#define SLOT_SIZE (PATTERN_SIZE + 1)
+// the slot stores the packed pattern + 1 byte CRC right after it
+#define SLOT_SIZE (SLOT_DATA_SIZE + 1)
 
 // Some math to calculate storage sizes:
-// 3 * 6 = 18 for the colorset
-// 1 + 7 + 1 + 1 = 10 for the rest
-//  = 28 bytes total for a pattern including CRC
-//    -> 8 slots = 8 * 28 = 224
-//      = 31 bytes left
-//    -> 9 slots = 9 * 28 = 252
-//      = 3 bytes left
+// 2 + 3 * 6 = 20 for the colorset with 6 colors that aren't from the menu
+// 1 + 6 + 1 + 1 = 9 for the version, params, flags and CRC
+//  = 29 bytes at most for a pattern including CRC
+//    -> a colorset of 6 menu colors is only 2 + 6 = 8 bytes
+//       so that pattern only takes 17 bytes including CRC
+
+// Storage Wear Leveling
+//
+// The slots and config are rewritten in place every time they are saved,
+// with wear leveling each save goes to the next record of a log in the
+// upper half of the eeprom instead so the writes are spread across all of
+// it, the lower half then only holds the copies that fell out of the log
+#define STORAGE_WEAR_LEVELING 1
+
+// Storage Log
+//
+// The log fills the upper half of the eeprom, each record in the log is a
+// sequence number and key (the slot or config) followed by the slot itself
+#define STORAGE_LOG_START STORAGE_SIZE
+#define STORAGE_LOG_SIZE 256
+#define LOG_RECORD_SIZE (SLOT_SIZE + 2)
+#define NUM_LOG_RECORDS (STORAGE_LOG_SIZE / LOG_RECORD_SIZE)
+
+// EEPROM Size
+//
+// The total size of the eeprom, the storage and the log
+#define EEPROM_SIZE (STORAGE_LOG_START + STORAGE_LOG_SIZE)
+
+// Storage Mode Cache
+//
+// Keep a copy of the mode slots in ram, the slots are read and checked once
+// at init then switching modes unpacks them out of ram instead of reading
+// the eeprom. The slots are kept packed like in the eeprom, which is about
+// 17 to 28 bytes each, and any slot that doesn't fit in the cache is still
+// read from the eeprom. The cli caches every slot, the device doesn't by
+// default because the default modes take 124 bytes and the attiny85 only
+// has about 100 bytes of stack to spare, reading a slot out of the eeprom
+// on a mode switch only takes a fraction of a millisecond anyway
+#ifndef STORAGE_MODE_CACHE
+#ifdef HELIOS_CLI
+#define STORAGE_MODE_CACHE 1
+#else
+#define STORAGE_MODE_CACHE 0
+#endif
+#endif
+#ifndef STORAGE_MODE_CACHE_SIZE
+#ifdef HELIOS_CLI
+#define STORAGE_MODE_CACHE_SIZE (NUM_MODE_SLOTS * SLOT_DATA_SIZE)
+#else
+#define STORAGE_MODE_CACHE_SIZE 128
+#endif
+#endif
+
+// Storage Legacy Migration
+//
+// Saves from before the storage format changed fail the crc of the new
+// format, if nothing is saved in the new format yet then init rewrites the
+// modes of an old save in the new format instead of falling back to defaults
+#define STORAGE_LEGACY_MIGRATION 1
 
 // forbidden constant:
 // #define HELIOS_ARDUINO 1
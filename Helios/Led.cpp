@@ -22,17 +22,68 @@
 
 #define SCALE8(i, scale)  (((uint16_t)i * (uint16_t)(scale)) >> 8)
 
+#if LED_GAMMA == 1
+#ifdef HELIOS_EMBEDDED
+#include <avr/pgmspace.h>
+#define GAMMA(i) pgm_read_byte(&gamma_table[i])
+#else
+#define PROGMEM
+#define GAMMA(i) gamma_table[i]
+#endif
+// round(255 * (i / 255) ^ 2.2)
+static const uint8_t gamma_table[256] PROGMEM = {
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+    1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+    3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+    6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+   12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+   20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+   30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+   42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+   56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+   73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+   91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+  113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+  137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+  163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+  192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+  223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+#else
+#define GAMMA(i) (i)
+#endif
+
+// the layers of the led
+HELIOS_LOCAL RGBColor Led::m_layers[LED_LAYER_COUNT];
+HELIOS_LOCAL uint8_t Led::m_drawnLayers = 0;
 // array of led color values
-RGBColor Led::m_ledColor = RGB_OFF;
-RGBColor Led::m_realColor = RGB_OFF;
+HELIOS_LOCAL RGBColor Led::m_ledColor = RGB_OFF;
+HELIOS_LOCAL RGBColor Led::m_realColor = RGB_OFF;
+#ifdef HELIOS_CLI
+HELIOS_LOCAL LedLayer Led::m_shownLayer = LED_LAYER_PATTERN;
+#endif
 // global brightness
-uint8_t Led::m_brightness = DEFAULT_BRIGHTNESS;
+HELIOS_LOCAL uint8_t Led::m_brightness = DEFAULT_BRIGHTNESS;
+#if LED_OUTPUT_LUT == 1
+// the output table, this is filled by init
+HELIOS_LOCAL uint8_t Led::m_outputTable[256];
+#endif
 
 bool Led::init()
 {
   // clear the led colors
+  for (uint8_t i = 0; i < LED_LAYER_COUNT; ++i) {
+    m_layers[i] = RGB_OFF;
+  }
+  m_drawnLayers = 0;
   m_ledColor = RGB_OFF;
   m_realColor = RGB_OFF;
+#ifdef HELIOS_CLI
+  m_shownLayer = LED_LAYER_PATTERN;
+#endif
+#if LED_OUTPUT_LUT == 1
+  buildOutputTable();
+#endif
 #ifdef HELIOS_EMBEDDED
 #ifdef HELIOS_ARDUINO
   pinMode(0, OUTPUT);
@@ -49,30 +100,53 @@ void Led::cleanup()
 {
 }
 
-void Led::set(RGBColor col)
+void Led::set(RGBColor col, LedLayer layer)
 {
-  m_ledColor = col;
-  m_realColor.red = SCALE8(m_ledColor.red, m_brightness);
-  m_realColor.green = SCALE8(m_ledColor.green, m_brightness);
-  m_realColor.blue = SCALE8(m_ledColor.blue, m_brightness);
+  m_layers[layer] = col;
+  m_drawnLayers |= (1 << layer);
 }
 
-void Led::set(uint8_t r, uint8_t g, uint8_t b)
+void Led::set(uint8_t r, uint8_t g, uint8_t b, LedLayer layer)
 {
-  set(RGBColor(r, g, b));
+  set(RGBColor(r, g, b), layer);
+}
+
+RGBColor Led::get()
+{
+  uint8_t layer = topLayer();
+  return (layer < LED_LAYER_COUNT) ? m_layers[layer] : m_ledColor;
 }
 
 void Led::adjustBrightness(uint8_t fadeBy)
 {
-  m_ledColor.adjustBrightness(fadeBy);
+  // dim whatever would be shown in the layer it was drawn in so the layers
+  // under it keep their colors, if nothing was drawn yet this tick the led
+  // stays on the last color so that is what gets dimmed
+  uint8_t layer = topLayer();
+  if (layer < LED_LAYER_COUNT) {
+    m_layers[layer].adjustBrightness(fadeBy);
+  } else {
+    m_ledColor.adjustBrightness(fadeBy);
+  }
 }
 
-void Led::strobe(uint16_t on_time, uint16_t off_time, RGBColor off_col, RGBColor on_col)
+void Led::setBrightness(uint8_t brightness)
 {
-  set(((Time::getCurtime() % (on_time + off_time)) > on_time) ? off_col : on_col);
+  if (m_brightness == brightness) {
+    return;
+  }
+  m_brightness = brightness;
+#if LED_OUTPUT_LUT == 1
+  buildOutputTable();
+#endif
 }
 
-void Led::breath(uint8_t hue, uint32_t duration, uint8_t magnitude, uint8_t sat, uint8_t val)
+void Led::strobe(uint16_t on_time, uint16_t off_time, RGBColor off_col, RGBColor on_col, LedLayer layer)
+{
+  set(((Time::getCurtime() % (on_time + off_time)) > on_time) ? off_col : on_col, layer);
+}
+
+void Led::breath(uint8_t hue, uint32_t duration, uint8_t magnitude, uint8_t sat, uint8_t val, LedLayer layer)
 {
   if (!duration) {
     // don't divide by 0
@@ -92,7 +166,7 @@ void Led::breath(uint8_t hue, uint32_t duration, uint8_t magnitude, uint8_t sat,
   // Apply hue shift - ensure hue stays within valid range
   uint8_t shiftedHue = hue + hueShift;
   // Apply the hsv color as a strobing hue shift
-  strobe(2, 13, RGB_OFF, HSVColor(shiftedHue, sat, val));
+  strobe(2, 13, RGB_OFF, HSVColor(shiftedHue, sat, val), layer);
 }
 
 void Led::hold(RGBColor col)
@@ -102,6 +176,18 @@ void Led::hold(RGBColor col)
   Time::delayMilliseconds(250);
 }
 
+uint8_t Led::topLayer()
+{
+  uint8_t layer = LED_LAYER_COUNT;
+  while (layer > 0) {
+    --layer;
+    if (m_drawnLayers & (1 << layer)) {
+      return layer;
+    }
+  }
+  return LED_LAYER_COUNT;
+}
+
 void Led::setPWM(uint8_t pwmPin, uint8_t pwmValue, volatile uint8_t &controlRegister,
     uint8_t controlBit, volatile uint8_t &compareRegister)
 {
@@ -122,8 +208,41 @@ void Led::setPWM(uint8_t pwmPin, uint8_t pwmValue, volatile uint8_t &controlRegi
 #endif
 }
 
+uint8_t Led::output(uint8_t value)
+{
+#if LED_OUTPUT_LUT == 1
+  return m_outputTable[value];
+#else
+  return SCALE8(GAMMA(value), m_brightness);
+#endif
+}
+
+#if LED_OUTPUT_LUT == 1
+void Led::buildOutputTable()
+{
+  uint8_t i = 0;
+  do {
+    m_outputTable[i] = SCALE8(GAMMA(i), m_brightness);
+  } while (++i);
+}
+#endif
+
 void Led::update()
 {
+  // the layers can be drawn any number of times in a tick, they are resolved
+  // once here and the brightness and gamma are only applied to the result.
+  // If nothing was drawn this tick the led just stays on the last color
+  uint8_t layer = topLayer();
+  if (layer < LED_LAYER_COUNT) {
+    m_ledColor = m_layers[layer];
+#ifdef HELIOS_CLI
+    m_shownLayer = (LedLayer)layer;
+#endif
+    m_drawnLayers = 0;
+  }
+  m_realColor.red = output(m_ledColor.red);
+  m_realColor.green = output(m_ledColor.green);
+  m_realColor.blue = output(m_ledColor.blue);
 #ifdef HELIOS_EMBEDDED
   // write out the rgb values to analog pins
 #ifdef HELIOS_ARDUINO
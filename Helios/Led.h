@@ -5,6 +5,21 @@
 
 #include "Colortypes.h"
 
+// the layers that the led is drawn in, each one is drawn over the ones before
+// it and only the highest layer that was drawn in a tick is shown
+enum LedLayer : uint8_t
+{
+  // the pattern that is playing
+  LED_LAYER_PATTERN,
+  // the menus and the options in them
+  LED_LAYER_MENU,
+  // the flash that shows a selection while the button is held
+  LED_LAYER_SELECTION,
+
+  // the number of layers
+  LED_LAYER_COUNT
+};
+
 class Led
 {
   // private unimplemented constructor
@@ -16,46 +31,82 @@ public:
   static bool init();
   static void cleanup();
 
-  // control individual LED, these are appropriate to use in internal pattern logic
-  static void set(RGBColor col);
-  static void set(uint8_t r, uint8_t g, uint8_t b);
+  // draw the LED in a layer, the pattern layer is appropriate to use in internal
+  // pattern logic. Nothing is shown till update picks the highest layer that was drawn
+  static void set(RGBColor col, LedLayer layer = LED_LAYER_PATTERN);
+  static void set(uint8_t r, uint8_t g, uint8_t b, LedLayer layer = LED_LAYER_PATTERN);
 
-  // Turn off individual LEDs, these are appropriate to use in internal pattern logic
-  static void clear() { set(RGB_OFF); }
+  // Turn off the LED in a layer, this still covers the layers below it
+  static void clear(LedLayer layer = LED_LAYER_PATTERN) { set(RGB_OFF, layer); }
 
-  // Dim individual LEDs, these are appropriate to use in internal pattern logic
+  // Dim the color that would be shown, this is the highest layer drawn so far
+  // in this tick or whatever was last shown if nothing has been drawn yet
   static void adjustBrightness(uint8_t fadeBy);
 
   // strobe between two colors with a simple on/off timing
-  static void strobe(uint16_t on_time, uint16_t off_time, RGBColor col1, RGBColor col2);
+  static void strobe(uint16_t on_time, uint16_t off_time, RGBColor col1, RGBColor col2,
+      LedLayer layer = LED_LAYER_PATTERN);
 
   // breath the hue on an index
   // warning: these use hsv to rgb in realtime!
   static void breath(uint8_t hue, uint32_t duration = 1000, uint8_t magnitude = 60,
-      uint8_t sat = 255, uint8_t val = 255);
+      uint8_t sat = 255, uint8_t val = 255, LedLayer layer = LED_LAYER_PATTERN);
 
   // a very specialized api to hold all leds on a color for 250ms
   static void hold(RGBColor col);
 
-  // get the RGBColor of an Led index
-  static RGBColor get() { return m_ledColor; }
+  // get the RGBColor of the Led, this is the highest layer drawn so far in
+  // this tick or whatever was last shown if nothing has been drawn yet
+  static RGBColor get();
+
+#ifdef HELIOS_CLI
+  // the layer that the color shown by the last update came from
+  static LedLayer getLayer() { return m_shownLayer; }
+#endif
 
   // global brightness
   static uint8_t getBrightness() { return m_brightness; }
-  static void setBrightness(uint8_t brightness) { m_brightness = brightness; }
+  static void setBrightness(uint8_t brightness);
 
-  // actually update the LEDs and show the changes
+  // actually update the LEDs and show the changes, this is where the brightness
+  // and gamma are applied to the color
   static void update();
 
 private:
   static void setPWM(uint8_t pwmPin, uint8_t pwmValue, volatile uint8_t &controlRegister,
       uint8_t controlBit, volatile uint8_t &compareRegister);
 
+  // the highest layer drawn this tick, or LED_LAYER_COUNT if none were
+  static uint8_t topLayer();
+
+  // the brightness and gamma applied to one channel of the led color
+  static uint8_t output(uint8_t value);
+#if LED_OUTPUT_LUT == 1
+  // fill the output table for the current brightness
+  static void buildOutputTable();
+#endif
+
   // the global brightness
-  static uint8_t m_brightness;
-  // led color
-  static RGBColor m_ledColor;
-  static RGBColor m_realColor;
+  static HELIOS_LOCAL uint8_t m_brightness;
+  // the color drawn in each layer and a bit for each layer drawn this tick
+  static HELIOS_LOCAL RGBColor m_layers[LED_LAYER_COUNT];
+  static HELIOS_LOCAL uint8_t m_drawnLayers;
+  // led color, and the real color that goes out to the pwm
+  static HELIOS_LOCAL RGBColor m_ledColor;
+  static HELIOS_LOCAL RGBColor m_realColor;
+#ifdef HELIOS_CLI
+  // the layer the led color came from
+  static HELIOS_LOCAL LedLayer m_shownLayer;
+#endif
+#if LED_OUTPUT_LUT == 1
+  // the output of each channel value at the current brightness
+  static HELIOS_LOCAL uint8_t m_outputTable[256];
+#endif
+
+#ifdef HELIOS_CLI
+  // the engine context swaps this state in and out
+  friend class EngineContext;
+#endif
 };
 
 #endif
@@ -9,6 +9,10 @@
 
 #include <string.h> // for memcpy
 
+#ifdef HELIOS_CLI
+#include "PatternTimeline.h"
+#endif
+
 // uncomment me to print debug labels on the pattern states, this is useful if you
 // are debugging a pattern strip from the command line and want to see what state
 // the pattern is in each tick of the pattern
@@ -17,18 +21,18 @@
 #ifdef DEBUG_BASIC_PATTERN
 #include "../../Time/TimeControl.h"
 #include <stdio.h>
-// print out the current state of the pattern
-#define PRINT_STATE(state) printState(state)
-static void printState(PatternState state)
+// print out the current segment of the pattern
+#define PRINT_STATE(segment) printState(segment)
+static void printState(uint8_t segment)
 {
   static uint64_t lastPrint = 0;
   if (lastPrint == Time::getCurtime()) return;
-  switch (m_state) {
-  case STATE_ON: printf("on  "); break;
-  case STATE_OFF: printf("off "); break;
-  case STATE_IN_GAP: printf("gap1"); break;
-  case STATE_IN_DASH: printf("dash"); break;
-  case STATE_IN_GAP2: printf("gap2"); break;
+  switch (segment) {
+  case 0: printf("on  "); break;
+  case 1: printf("off "); break;
+  case 2: printf("gap1"); break;
+  case 3: printf("dash"); break;
+  case 4: printf("gap2"); break;
   default: return;
   }
   lastPrint = Time::getCurtime();
@@ -43,11 +47,13 @@ Pattern::Pattern(uint8_t onDur, uint8_t offDur, uint8_t gap,
   m_patternFlags(0),
   m_colorset(),
   m_groupCounter(0),
-  m_state(STATE_BLINK_ON),
+  m_segments(),
+  m_segment(SEGMENT_START_BLINK),
   m_blinkTimer(),
   m_cur(),
   m_next()
 {
+  compile();
 }
 
 Pattern::Pattern(const PatternArgs &args) :
@@ -64,121 +70,201 @@ void Pattern::init()
 {
   m_colorset.resetIndex();
 
-  // the default state to begin with
-  m_state = STATE_BLINK_ON;
+  // the default segment to begin with
+  m_segment = SEGMENT_START_BLINK;
   // if a dash is present then always start with the dash because
   // it consumes the first color in the colorset
   if (m_args.dash_dur > 0) {
-    m_state = STATE_BEGIN_DASH;
+    m_segment = SEGMENT_START_DASH;
   }
   // if there's no on duration or dash duration the led is just disabled
   if ((!m_args.on_dur && !m_args.dash_dur) || !m_colorset.numColors()) {
-    m_state = STATE_DISABLED;
+    m_segment = SEGMENT_DISABLED;
   }
-  m_groupCounter = m_args.group_size ? m_args.group_size : (m_colorset.numColors() - (m_args.dash_dur != 0));
+  m_groupCounter = groupSize();
+  compile();
 
   if (m_args.blend_speed > 0) {
     // convert current/next colors to HSV but only if we are doing a blend
     m_cur = m_colorset.getNext();
     m_next = m_colorset.getNext();
   }
+
+#ifdef HELIOS_CLI
+  // the blink timer isn't started till the pattern first plays so there is no
+  // deadline to wait for, the pattern changes right away unless it's disabled
+  m_blinkTimer.reset();
+  if (m_segment != SEGMENT_DISABLED) {
+    m_blinkTimer.publishDeadline(Time::getCurtime());
+  }
+#endif
 }
 
 void Pattern::play()
 {
-  // Sometimes the pattern needs to cycle multiple states in a single frame so
-  // instead of using a loop or recursion I have just used a simple goto
-replay:
+  if (m_segment == SEGMENT_DISABLED) {
+    return;
+  }
+  // the start segments end right away, the rest last till the blink timer hits
+  if (m_segment < SEGMENT_START_BLINK && !m_blinkTimer.alarm()) {
+    // no alarm triggered just stay in current segment
+    PRINT_STATE(m_segment);
+    return;
+  }
+  // the segment ended so step to the next one in the table and begin it
+  m_segment = nextSegment(m_segment, m_groupCounter);
+  beginSegment();
+}
+
+// set args
+void Pattern::setArgs(const PatternArgs &args)
+{
+  memcpy(&m_args, &args, sizeof(PatternArgs));
+  // the segment table is built from the args
+  compile();
+}
 
-  // its kinda evolving as i go
-  switch (m_state) {
-  case STATE_DISABLED:
+void Pattern::compile()
+{
+  // without an on or a dash there is nothing to play
+  if (!m_args.on_dur && !m_args.dash_dur) {
+    m_segment = SEGMENT_DISABLED;
     return;
-  case STATE_BLINK_ON:
-    if (m_args.on_dur > 0) {
-      onBlinkOn();
-      --m_groupCounter;
-      nextState(m_args.on_dur);
-      return;
+  }
+  // the segment that follows each segment only depends on the args and
+  // whether the group counter has reached zero, so work both out up front
+  for (uint8_t i = 0; i < SEGMENT_COUNT; ++i) {
+    m_segments[i] = resolveSegment(i, true) | (resolveSegment(i, false) << 4);
+  }
+}
+
+uint8_t Pattern::resolveSegment(uint8_t segment, bool counting) const
+{
+  // these are the steps the pattern takes from the end of each segment,
+  // it can take several steps to get to the next segment with a duration
+  switch (segment) {
+  case SEGMENT_ON:
+    goto blink_off;
+  case SEGMENT_OFF:
+    // the off blink goes back to the next blink unless the group is done
+    if (!counting) {
+      return SEGMENT_RESTART;
     }
-    m_state = STATE_BLINK_OFF;
-  case STATE_BLINK_OFF:
-    // the whole 'should blink off' situation is tricky because we might need
-    // to go back to blinking on if our colorset isn't at the end yet
-    if (m_groupCounter > 0 || (!m_args.gap_dur && !m_args.dash_dur)) {
-      if (m_args.off_dur > 0) {
-        onBlinkOff();
-        nextState(m_args.off_dur);
-        return;
-      }
-      if (m_groupCounter > 0 && m_args.on_dur > 0) {
-        m_state = STATE_BLINK_ON;
-        goto replay;
-      }
+    goto repeat;
+  case SEGMENT_GAP:
+  case SEGMENT_START_DASH:
+    goto begin_dash;
+  case SEGMENT_DASH:
+    goto begin_gap2;
+  case SEGMENT_GAP2:
+    goto repeat;
+  case SEGMENT_RESTART:
+    goto begin_gap;
+  default:
+    goto blink_on;
+  }
+repeat:
+  // start over with whatever comes first of a blink, a dash, or a gap
+  if (!m_args.on_dur) {
+    if (m_args.dash_dur > 0) {
+      goto begin_dash;
     }
-    m_state = STATE_BEGIN_GAP;
-  case STATE_BEGIN_GAP:
-    m_groupCounter = m_args.group_size ? m_args.group_size : (m_colorset.numColors() - (m_args.dash_dur != 0));
-    if (m_args.gap_dur > 0) {
-      beginGap();
-      nextState(m_args.gap_dur);
-      return;
+    return SEGMENT_RESTART;
+  }
+blink_on:
+  if (m_args.on_dur > 0) {
+    return SEGMENT_ON;
+  }
+blink_off:
+  // the whole 'should blink off' situation is tricky because we might need
+  // to go back to blinking on if our colorset isn't at the end yet
+  if (counting || (!m_args.gap_dur && !m_args.dash_dur)) {
+    if (m_args.off_dur > 0) {
+      return SEGMENT_OFF;
     }
-    m_state = STATE_BEGIN_DASH;
-  case STATE_BEGIN_DASH:
-    if (m_args.dash_dur > 0) {
-      beginDash();
-      nextState(m_args.dash_dur);
-      return;
+    if (counting && m_args.on_dur > 0) {
+      return SEGMENT_ON;
     }
-    m_state = STATE_BEGIN_GAP2;
-  case STATE_BEGIN_GAP2:
-    if (m_args.dash_dur > 0 && m_args.gap_dur > 0) {
-      beginGap();
-      nextState(m_args.gap_dur);
-      return;
+  }
+  // the group counter has to restart before the gap, the segment after
+  // that depends on the restarted group counter so leave it till then
+  if (segment != SEGMENT_RESTART) {
+    return SEGMENT_RESTART;
+  }
+begin_gap:
+  if (m_args.gap_dur > 0) {
+    return SEGMENT_GAP;
+  }
+begin_dash:
+  if (m_args.dash_dur > 0) {
+    return SEGMENT_DASH;
+  }
+begin_gap2:
+  if (m_args.dash_dur > 0 && m_args.gap_dur > 0) {
+    return SEGMENT_GAP2;
+  }
+  goto blink_on;
+}
+
+uint8_t Pattern::nextSegment(uint8_t segment, uint8_t &groupCounter) const
+{
+  do {
+    if (segment == SEGMENT_RESTART) {
+      groupCounter = groupSize();
     }
-    m_state = STATE_BLINK_ON;
-    goto replay;
-  default:
-    break;
+    segment = m_segments[segment];
+    if (!groupCounter) {
+      segment >>= 4;
+    }
+    segment &= 0xF;
+  } while (segment == SEGMENT_RESTART);
+  if (segment == SEGMENT_ON) {
+    --groupCounter;
   }
+  return segment;
+}
 
-  if (!m_blinkTimer.alarm()) {
-    // no alarm triggered just stay in current state, return and don't transition states
-    PRINT_STATE(m_state);
-    return;
+void Pattern::beginSegment()
+{
+  switch (m_segment) {
+  case SEGMENT_ON:
+    onBlinkOn();
+    break;
+  case SEGMENT_OFF:
+    onBlinkOff();
+    break;
+  case SEGMENT_DASH:
+    beginDash();
+    break;
+  default:
+    beginGap();
+    break;
   }
+  m_blinkTimer.init(segmentDuration(m_segment));
+}
 
-  // this just transitions the state into the next state, with some edge conditions for
-  // transitioning to different states under certain circumstances. Honestly this is
-  // a nightmare to read now and idk how to fix it
-  if (m_state == STATE_IN_GAP2 || (m_state == STATE_OFF && m_groupCounter > 0)) {
-    // this is an edge condition for when in the second gap or off in the non-last off blink
-    // then the state actually needs to jump backwards rather than iterate
-    m_state = m_args.on_dur ? STATE_BLINK_ON : (m_args.dash_dur ? STATE_BEGIN_DASH : STATE_BEGIN_GAP);
-  } else if (m_state == STATE_OFF && (!m_groupCounter || m_colorset.numColors() == 1)) {
-    // this is an edge condition when the state is off but this is the last off blink in the
-    // group or there's literally only one color in the group then if there is more blinks
-    // left in the group we need to cycle back to blink on instead of to the next state
-    m_state = (m_groupCounter > 0) ? STATE_BLINK_ON : STATE_BEGIN_GAP;
-  } else {
-    // this is the standard case, iterate to the next state
-    m_state = (PatternState)(m_state + 1);
+uint8_t Pattern::segmentDuration(uint8_t segment) const
+{
+  switch (segment) {
+  case SEGMENT_ON:
+    return m_args.on_dur;
+  case SEGMENT_OFF:
+    return m_args.off_dur;
+  case SEGMENT_DASH:
+    return m_args.dash_dur;
+  default:
+    return m_args.gap_dur;
   }
-  // poor-mans recurse with the new state change (this transitions to a new state within the same tick)
-  goto replay;
 }
 
-// set args
-void Pattern::setArgs(const PatternArgs &args)
+uint8_t Pattern::groupSize() const
 {
-  memcpy(&m_args, &args, sizeof(PatternArgs));
+  return m_args.group_size ? m_args.group_size : (m_colorset.numColors() - (m_args.dash_dur != 0));
 }
 
 void Pattern::onBlinkOn()
 {
-  PRINT_STATE(STATE_ON);
+  PRINT_STATE(SEGMENT_ON);
   if (isBlend()) {
     blendBlinkOn();
     return;
@@ -188,28 +274,22 @@ void Pattern::onBlinkOn()
 
 void Pattern::onBlinkOff()
 {
-  PRINT_STATE(STATE_OFF);
+  PRINT_STATE(SEGMENT_OFF);
   Led::clear();
 }
 
 void Pattern::beginGap()
 {
-  PRINT_STATE(STATE_IN_GAP);
+  PRINT_STATE(SEGMENT_GAP);
   Led::clear();
 }
 
 void Pattern::beginDash()
 {
-  PRINT_STATE(STATE_IN_DASH);
+  PRINT_STATE(SEGMENT_DASH);
   Led::set(m_colorset.getNext());
 }
 
-void Pattern::nextState(uint8_t timing)
-{
-  m_blinkTimer.init(timing);
-  m_state = (PatternState)(m_state + 1);
-}
-
 // change the colorset
 void Pattern::setColorset(const Colorset &set)
 {
@@ -246,15 +326,71 @@ void Pattern::updateColor(uint8_t index, const RGBColor &col)
   init();
 }
 
+// add one byte to the djb2 hash of a pattern
+#define HASH_BYTE(hash, byte) (((hash) << 5) + (hash) + (uint8_t)(byte))
+
 uint32_t Pattern::crc32() const
 {
+  // the args, flags and then every slot of the colorset, this is hashed
+  // field by field so the hash doesn't depend on how the pattern is laid out
   uint32_t hash = 5381;
-  for (uint8_t i = 0; i < PATTERN_SIZE; ++i) {
-    hash = ((hash << 5) + hash) + ((uint8_t *)this)[i];
+  const uint8_t *args = (const uint8_t *)&m_args;
+  for (uint8_t i = 0; i < PAT_ARGS_SIZE; ++i) {
+    hash = HASH_BYTE(hash, args[i]);
   }
+  hash = HASH_BYTE(hash, m_patternFlags);
+  for (uint8_t i = 0; i < NUM_COLOR_SLOTS; ++i) {
+    RGBColor col = m_colorset.get(i);
+    hash = HASH_BYTE(hash, col.red);
+    hash = HASH_BYTE(hash, col.green);
+    hash = HASH_BYTE(hash, col.blue);
+  }
+  hash = HASH_BYTE(hash, m_colorset.numColors());
   return hash;
 }
 
+uint8_t Pattern::serialize(uint8_t *buf) const
+{
+  buf[0] = PATTERN_FORMAT_VERSION;
+  uint8_t size = 1 + m_colorset.pack(buf + 1);
+  memcpy(buf + size, (const void *)&m_args, PAT_ARGS_SIZE);
+  size += PAT_ARGS_SIZE;
+  buf[size++] = m_patternFlags;
+  return size;
+}
+
+bool Pattern::unserialize(const uint8_t *buf)
+{
+  if (!serializedSize(buf)) {
+    return false;
+  }
+  uint8_t offset = 1 + Colorset::packedSize(buf + 1);
+  m_colorset.unpack(buf + 1);
+  memcpy((void *)&m_args, buf + offset, PAT_ARGS_SIZE);
+  m_patternFlags = buf[offset + PAT_ARGS_SIZE];
+  return true;
+}
+
+uint8_t Pattern::serializedSize(const uint8_t *buf)
+{
+  // a save from any other version of the format can't be read
+  if (buf[0] != PATTERN_FORMAT_VERSION) {
+    return 0;
+  }
+  uint8_t size = Colorset::packedSize(buf + 1);
+  if (!size) {
+    return 0;
+  }
+  return 1 + size + PAT_ARGS_SIZE + 1;
+}
+
+#ifdef HELIOS_CLI
+RGBColor Pattern::colorAt(uint32_t tick) const
+{
+  return PatternTimeline(*this).colorAt(tick);
+}
+#endif
+
 void Pattern::blendBlinkOn()
 {
   // if we reached the next color, then cycle the colorset
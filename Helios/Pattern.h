@@ -55,13 +55,34 @@ public:
   // calculate crc of the colorset + pattern
   uint32_t crc32() const;
 
+  // pack the pattern into the save format: the format version, the packed
+  // colorset, the args then the flags. Returns the number of bytes packed
+  uint8_t serialize(uint8_t *buf) const;
+  // load a pattern out of the save format, returns false if it isn't valid
+  bool unserialize(const uint8_t *buf);
+  // the number of bytes a serialized pattern takes, this is worked out from
+  // the first PATTERN_HEADER_SIZE bytes and is 0 if they aren't valid
+  static uint8_t serializedSize(const uint8_t *buf);
+
   // get the pattern flags
   uint32_t getFlags() const { return m_patternFlags; }
+  void setFlags(uint8_t flags) { m_patternFlags = flags; }
   bool hasFlags(uint32_t flags) const { return (m_patternFlags & flags) != 0; }
 
   // whether blend speed is non 0
   bool isBlend() const { return m_args.blend_speed > 0; }
 
+#ifdef HELIOS_CLI
+  // the color the pattern shows on a tick after init without playing up to
+  // it, this builds a PatternTimeline each call so keep a timeline around
+  // instead if many ticks are needed
+  RGBColor colorAt(uint32_t tick) const;
+
+  // report the deadline of the blink timer to a slot of the deadline table
+  // in Time, only the pattern the engine plays does this
+  void reportDeadline(uint8_t slot) { m_blinkTimer.reportDeadline(slot); }
+#endif
+
 protected:
   // ==================================
   //  Pattern Parameters
@@ -84,37 +105,57 @@ protected:
   void onBlinkOff();
   void beginGap();
   void beginDash();
-  void nextState(uint8_t timing);
 
-  // the various different blinking states the pattern can be in
-  enum PatternState : uint8_t
+  // the segments a pattern is made of, the first five are played for their
+  // duration and the rest are only passed through on the way to the next one
+  enum PatternSegment : uint8_t
   {
-    // the led is disabled (there is no on or dash)
-    STATE_DISABLED,
-
-    // the pattern is blinking on the next color in the set
-    STATE_BLINK_ON,
-    STATE_ON,
+    // the pattern blinks on the next color in the set
+    SEGMENT_ON,
+    // the pattern blinks off between colors
+    SEGMENT_OFF,
+    // the gap after a colorset
+    SEGMENT_GAP,
+    // the dash after a colorset or gap
+    SEGMENT_DASH,
+    // the gap after a dash
+    SEGMENT_GAP2,
+
+    // where the pattern starts from without and with a dash
+    SEGMENT_START_BLINK,
+    SEGMENT_START_DASH,
+    // the group counter restarts before the gap
+    SEGMENT_RESTART,
+
+    // the number of segments in the segment table
+    SEGMENT_COUNT,
 
-    // the pattern is blinking off
-    STATE_BLINK_OFF,
-    STATE_OFF,
-
-    // the pattern is starting a gap after a colorset
-    STATE_BEGIN_GAP,
-    STATE_IN_GAP,
-
-    // the pattern is beginning a dash after a colorset or gap
-    STATE_BEGIN_DASH,
-    STATE_IN_DASH,
-
-    // the pattern is starting a gap after a dash
-    STATE_BEGIN_GAP2,
-    STATE_IN_GAP2,
+    // the led is disabled (there is no on or dash)
+    SEGMENT_DISABLED = SEGMENT_COUNT,
   };
 
-  // the state of the current pattern
-  PatternState m_state;
+  // compile the args into the segment table
+  void compile();
+  // work out which segment follows the end of a segment, this is the
+  // chain of steps the pattern takes to get to the next segment it plays
+  uint8_t resolveSegment(uint8_t segment, bool counting) const;
+  // step from a segment to the next one that is played, this updates the
+  // group counter the same way that playing the pattern does
+  uint8_t nextSegment(uint8_t segment, uint8_t &groupCounter) const;
+  // begin playing the current segment
+  void beginSegment();
+  // the number of ticks a segment lasts
+  uint8_t segmentDuration(uint8_t segment) const;
+  // the group counter starts from the group size or the number of colors
+  uint8_t groupSize() const;
+
+  // the segment table, for each segment the low nibble is the segment that
+  // follows it while the group counter is above zero and the high nibble is
+  // the one that follows it once the group counter reaches zero
+  uint8_t m_segments[SEGMENT_COUNT];
+
+  // the segment of the pattern that is playing
+  uint8_t m_segment;
 
   // the blink timer used to measure blink timings
   Timer m_blinkTimer;
@@ -129,6 +170,11 @@ protected:
   // apis for blend
   void blendBlinkOn();
   void interpolate(uint8_t &current, const uint8_t next);
+
+#ifdef HELIOS_CLI
+  // the timeline works out the cycle of the pattern from these members
+  friend class PatternTimeline;
+#endif
 };
 
 #endif
@@ -0,0 +1,280 @@
+#include "PatternTimeline.h"
+
+#ifdef HELIOS_CLI
+
+#include <algorithm>
+#include <unordered_map>
+
+PatternTimeline::PatternTimeline(const Pattern &pat) :
+  m_pattern(pat),
+  m_disabled(false),
+  m_segments(),
+  m_cycleStart(0),
+  m_prefixTicks(0),
+  m_prefixEvents(0),
+  m_cycleTicks(0),
+  m_cycleEvents(0),
+  m_colors(),
+  m_colorTransient(0),
+  m_colorPeriod(0),
+  m_periodFound(false),
+  m_transient(0),
+  m_period(1)
+{
+  const PatternArgs &args = m_pattern.m_args;
+  // same condition that Pattern::init uses to disable the pattern
+  if ((!args.on_dur && !args.dash_dur) || !m_pattern.m_colorset.numColors()) {
+    m_disabled = true;
+    return;
+  }
+  buildSegments();
+  buildColors();
+}
+
+PatternTimeline::~PatternTimeline()
+{
+}
+
+RGBColor PatternTimeline::colorAt(uint32_t tick) const
+{
+  if (m_disabled) {
+    return RGB_OFF;
+  }
+  uint32_t offset;
+  return segmentColor(tick, offset);
+}
+
+uint32_t PatternTimeline::transient()
+{
+  findPeriod();
+  return m_transient;
+}
+
+uint32_t PatternTimeline::period()
+{
+  findPeriod();
+  return m_period;
+}
+
+void PatternTimeline::buildSegments()
+{
+  const PatternArgs &args = m_pattern.m_args;
+  // the same segment table and starting point that Pattern::init sets up
+  m_pattern.compile();
+  uint8_t segment = args.dash_dur ? Pattern::SEGMENT_START_DASH : Pattern::SEGMENT_START_BLINK;
+  uint8_t groupCounter = m_pattern.groupSize();
+  // the segment and group counter are all that decide which segments come
+  // next so the first time a segment begins with the same pair the cycle is found
+  std::unordered_map<uint16_t, uint32_t> seen;
+  uint32_t ticks = 0;
+  uint32_t events = 0;
+  for (;;) {
+    segment = m_pattern.nextSegment(segment, groupCounter);
+    uint16_t key = (uint16_t)((segment << 8) | groupCounter);
+    std::unordered_map<uint16_t, uint32_t>::iterator it = seen.find(key);
+    if (it != seen.end()) {
+      m_cycleStart = it->second;
+      break;
+    }
+    seen[key] = (uint32_t)m_segments.size();
+    Segment seg;
+    seg.start = ticks;
+    seg.event = events;
+    seg.duration = m_pattern.segmentDuration(segment);
+    seg.type = segment;
+    m_segments.push_back(seg);
+    ticks += seg.duration;
+    if (segment == Pattern::SEGMENT_ON || segment == Pattern::SEGMENT_DASH) {
+      events++;
+    }
+  }
+  m_prefixTicks = m_segments[m_cycleStart].start;
+  m_prefixEvents = m_segments[m_cycleStart].event;
+  m_cycleTicks = ticks - m_prefixTicks;
+  m_cycleEvents = events - m_prefixEvents;
+}
+
+void PatternTimeline::buildColors()
+{
+  const Colorset &colorset = m_pattern.m_colorset;
+  uint8_t numColors = colorset.numColors();
+  if (!m_pattern.isBlend()) {
+    // without blend each on or dash shows the next color in the colorset
+    for (uint8_t i = 0; i < numColors; ++i) {
+      m_colors.push_back(colorset[i]);
+    }
+    m_colorTransient = 0;
+    m_colorPeriod = numColors;
+    return;
+  }
+  // with blend the colors are worked out by running the blend over each run
+  // of the cycle until it starts a run in the same place it started another,
+  // the colorset index is tracked because the dash also takes colors from it
+  uint8_t index = 0;
+  auto nextColor = [&]() {
+    RGBColor col = colorset[index];
+    index = (index + 1) % numColors;
+    return col;
+  };
+  m_pattern.m_cur = nextColor();
+  m_pattern.m_next = nextColor();
+  std::unordered_map<uint64_t, uint32_t> seen;
+  uint32_t segment = 0;
+  for (;;) {
+    if (segment == m_cycleStart) {
+      uint64_t key = ((uint64_t)m_pattern.m_cur.raw() << 32) |
+        ((uint64_t)m_pattern.m_next.raw() << 8) | index;
+      std::unordered_map<uint64_t, uint32_t>::iterator it = seen.find(key);
+      if (it != seen.end()) {
+        m_colorTransient = it->second;
+        m_colorPeriod = (uint32_t)m_colors.size() - it->second;
+        return;
+      }
+      seen[key] = (uint32_t)m_colors.size();
+    }
+    const Segment &seg = m_segments[segment];
+    if (seg.type == Pattern::SEGMENT_ON) {
+      // same as Pattern::blendBlinkOn
+      if (m_pattern.m_cur == m_pattern.m_next) {
+        m_pattern.m_next = nextColor();
+      }
+      m_pattern.interpolate(m_pattern.m_cur.red, m_pattern.m_next.red);
+      m_pattern.interpolate(m_pattern.m_cur.green, m_pattern.m_next.green);
+      m_pattern.interpolate(m_pattern.m_cur.blue, m_pattern.m_next.blue);
+      m_colors.push_back(m_pattern.m_cur);
+    } else if (seg.type == Pattern::SEGMENT_DASH) {
+      m_colors.push_back(nextColor());
+    }
+    if (++segment == m_segments.size()) {
+      segment = m_cycleStart;
+    }
+  }
+}
+
+RGBColor PatternTimeline::eventColor(uint64_t event) const
+{
+  if (event < m_colorTransient) {
+    return m_colors[event];
+  }
+  return m_colors[m_colorTransient + ((event - m_colorTransient) % m_colorPeriod)];
+}
+
+RGBColor PatternTimeline::segmentColor(uint64_t tick, uint32_t &offset) const
+{
+  // fold the tick into the cycle and count how many times it has run
+  uint64_t runs = 0;
+  if (tick >= m_prefixTicks) {
+    runs = (tick - m_prefixTicks) / m_cycleTicks;
+    tick = m_prefixTicks + ((tick - m_prefixTicks) % m_cycleTicks);
+  }
+  // the last segment that starts at or before the tick
+  std::vector<Segment>::const_iterator seg = std::upper_bound(m_segments.begin(), m_segments.end(), tick,
+    [](uint64_t t, const Segment &s) { return t < s.start; }) - 1;
+  offset = (uint32_t)(tick - seg->start);
+  if (seg->type != Pattern::SEGMENT_ON && seg->type != Pattern::SEGMENT_DASH) {
+    return RGB_OFF;
+  }
+  return eventColor(seg->event + (runs * m_cycleEvents));
+}
+
+void PatternTimeline::findPeriod()
+{
+  if (m_periodFound) {
+    return;
+  }
+  m_periodFound = true;
+  // a disabled pattern never changes the led
+  if (m_disabled) {
+    return;
+  }
+  // the segments repeat every run of the cycle and the colors repeat every
+  // color period, so the whole output repeats once enough runs have passed
+  // for the colors to line up again with the start of a run
+  uint32_t a = m_colorPeriod;
+  uint32_t b = m_cycleEvents;
+  while (b) {
+    uint32_t r = a % b;
+    a = b;
+    b = r;
+  }
+  uint64_t runsPerPeriod = m_colorPeriod / a;
+  // and that only holds after both the segments and colors are in their cycle
+  uint64_t runsToSettle = 0;
+  if (m_colorTransient > m_prefixEvents) {
+    runsToSettle = (m_colorTransient - m_prefixEvents + m_cycleEvents - 1) / m_cycleEvents;
+  }
+  uint64_t start = m_prefixTicks + (runsToSettle * m_cycleTicks);
+  // that is a period but not always the shortest one, for example the same
+  // color twice in a row. One full repeat can be billions of ticks with big
+  // groups and slow blends so it is never laid out tick by tick, instead the
+  // segments of it are merged into runs of the same color
+  struct Run
+  {
+    uint32_t color;
+    uint64_t ticks;
+    bool operator!=(const Run &other) const { return color != other.color || ticks != other.ticks; }
+  };
+  std::vector<Run> runs;
+  for (uint64_t cycle = runsToSettle; cycle < runsToSettle + runsPerPeriod; ++cycle) {
+    for (uint32_t i = m_cycleStart; i < m_segments.size(); ++i) {
+      const Segment &seg = m_segments[i];
+      if (!seg.duration) {
+        continue;
+      }
+      uint32_t color = 0;
+      if (seg.type == Pattern::SEGMENT_ON || seg.type == Pattern::SEGMENT_DASH) {
+        color = eventColor(seg.event + (cycle * m_cycleEvents)).raw();
+      }
+      if (!runs.empty() && runs.back().color == color) {
+        runs.back().ticks += seg.duration;
+      } else {
+        runs.push_back({ color, seg.duration });
+      }
+    }
+  }
+  uint64_t period = 1;
+  if (runs.size() > 1) {
+    // the repeat wraps around onto itself, so the run at the end carries on
+    // into the run at the start if they are the same color
+    if (runs.front().color == runs.back().color) {
+      runs.front().ticks += runs.back().ticks;
+      runs.pop_back();
+    }
+    // then the shortest period of the runs is found with the prefix function
+    // of them, a period of the output always begins and ends on a run
+    uint32_t length = (uint32_t)runs.size();
+    std::vector<uint32_t> prefix(length, 0);
+    for (uint32_t i = 1; i < length; ++i) {
+      uint32_t k = prefix[i - 1];
+      while (k > 0 && runs[i] != runs[k]) {
+        k = prefix[k - 1];
+      }
+      if (!(runs[i] != runs[k])) {
+        k++;
+      }
+      prefix[i] = k;
+    }
+    uint32_t count = length - prefix[length - 1];
+    if (length % count) {
+      count = length;
+    }
+    period = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      period += runs[i].ticks;
+    }
+  }
+  // then walk the start back for as long as the output was already repeating,
+  // a whole segment at a time because the color only changes between them
+  while (start > 0) {
+    uint32_t offset;
+    uint32_t repeatOffset;
+    if (segmentColor(start - 1, offset) != segmentColor(start - 1 + period, repeatOffset)) {
+      break;
+    }
+    start -= (uint64_t)std::min(offset, repeatOffset) + 1;
+  }
+  m_transient = (uint32_t)std::min<uint64_t>(start, UINT32_MAX);
+  m_period = (uint32_t)std::min<uint64_t>(period, UINT32_MAX);
+}
+
+#endif
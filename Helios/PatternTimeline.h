@@ -0,0 +1,95 @@
+#ifndef PATTERN_TIMELINE_H
+#define PATTERN_TIMELINE_H
+
+#include "HeliosConfig.h"
+
+// The timeline is only used on the host builds for seeking through patterns,
+// the embedded build only ever plays patterns forward one tick at a time
+#ifdef HELIOS_CLI
+
+#include <inttypes.h>
+#include <vector>
+
+#include "Colortypes.h"
+#include "Colorset.h"
+#include "Pattern.h"
+
+// A pattern timeline is the cycle structure of a pattern worked out from the
+// args and colorset of the pattern. The on/off/gap/dash segments of a pattern
+// always settle into a fixed cycle and the colors that are shown do as well,
+// even with blend, so once the timeline has been built the color of the
+// pattern at any tick can be found without playing the pattern up to it.
+class PatternTimeline
+{
+public:
+  PatternTimeline(const Pattern &pat);
+  ~PatternTimeline();
+
+  // the color the pattern shows on the given tick, where tick 0 is the
+  // first tick the pattern is played after it was initialized
+  RGBColor colorAt(uint32_t tick) const;
+
+  // the exact number of ticks before the output of the pattern begins to
+  // repeat, this is normally 0 but blends can take a while to settle
+  uint32_t transient();
+  // the exact number of ticks it takes the output of the pattern to repeat
+  // after the transient, this is the shortest period of the colors shown
+  // so a colorset of the same color twice has half the period it seems to,
+  // both are capped at UINT32_MAX the same as the ticks of colorAt
+  uint32_t period();
+
+private:
+  struct Segment
+  {
+    // the tick this segment starts on
+    uint32_t start;
+    // the number of colors that were shown before this segment
+    uint32_t event;
+    // the number of ticks this segment lasts
+    uint8_t duration;
+    // the segment of the pattern, only on and dash segments show a color
+    uint8_t type;
+  };
+
+  // work out the segments of the pattern from the segment table
+  void buildSegments();
+  // work out the sequence of colors the on and dash segments will show
+  void buildColors();
+  // the color of the Nth on or dash segment of the pattern
+  RGBColor eventColor(uint64_t event) const;
+  // the color on a tick and how many ticks into its segment the tick is
+  RGBColor segmentColor(uint64_t tick, uint32_t &offset) const;
+  // work out the transient and period of the output, only done when needed
+  void findPeriod();
+
+  // a copy of the pattern the timeline was built from
+  Pattern m_pattern;
+  // whether the pattern is disabled and never shows anything
+  bool m_disabled;
+
+  // the segments before the cycle followed by one run of the cycle
+  std::vector<Segment> m_segments;
+  // the first segment of the cycle
+  uint32_t m_cycleStart;
+  // the ticks and colors before the cycle begins
+  uint32_t m_prefixTicks;
+  uint32_t m_prefixEvents;
+  // the ticks and colors in one run of the cycle
+  uint32_t m_cycleTicks;
+  uint32_t m_cycleEvents;
+
+  // the colors shown by the on and dash segments, the first transient colors
+  // are only shown once then the rest of them repeat for the whole pattern
+  std::vector<RGBColor> m_colors;
+  uint32_t m_colorTransient;
+  uint32_t m_colorPeriod;
+
+  // the transient and period of the output in ticks once they are found
+  bool m_periodFound;
+  uint32_t m_transient;
+  uint32_t m_period;
+};
+
+#endif
+
+#endif
@@ -30,11 +30,15 @@ static const default_colorset default_colorsets[] = {
   { 6, color_codes5 },  // 5 Rainbow Glitter
 };
 
+// the number of default modes, any mode slots past these repeat them
+#define NUM_DEFAULT_MODES (sizeof(default_colorsets) / sizeof(default_colorsets[0]))
+
 void Patterns::make_default(uint8_t index, Pattern &pat)
 {
   if (index >= NUM_MODE_SLOTS) {
     return;
   }
+  index %= NUM_DEFAULT_MODES;
   PatternArgs args;
   switch (index) {
     case 0:  // Lightside
@@ -1,163 +1,794 @@
 #include "Storage.h"
 
 #include "Colorset.h"
+#include "Patterns.h"
 #include "Pattern.h"
 
+#include <string.h>
+
 #ifdef HELIOS_EMBEDDED
 #include <avr/io.h>
+#include <avr/pgmspace.h>
+// the crc table lives in flash and has to be read from there
+#define CRC8_TABLE(index) pgm_read_byte(&crc8_table[index])
+#else
+#define PROGMEM
+#define CRC8_TABLE(index) crc8_table[index]
 #endif
 
 #ifdef HELIOS_CLI
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
-#include <errno.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
+// the crc-8 (polynomial 0x07) of each nibble, the crc of a byte is found
+// one nibble at a time so the table only needs 16 entries instead of 256
+static const uint8_t crc8_table[16] PROGMEM = {
+  0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+  0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
 #ifdef HELIOS_CLI
 // whether storage is enabled, default enabled
-bool Storage::m_enableStorage = true;
+HELIOS_LOCAL bool Storage::m_enableStorage = true;
+// the in-memory storage image, by default the storage file is used
+HELIOS_LOCAL uint8_t *Storage::m_storageImage = nullptr;
+// the storage file, it's only mapped into memory once storage is initialized
+HELIOS_LOCAL const char *Storage::m_storageFile = STORAGE_FILENAME;
+HELIOS_LOCAL uint8_t *Storage::m_mappedImage = nullptr;
+#endif
+
+// nothing is staged till something is saved
+HELIOS_LOCAL uint8_t Storage::m_pendingData[SLOT_DATA_SIZE];
+HELIOS_LOCAL uint8_t Storage::m_pendingSlot = STORAGE_KEY_NONE;
+HELIOS_LOCAL uint8_t Storage::m_pendingSize = 0;
+HELIOS_LOCAL bool Storage::m_configDirty = false;
+HELIOS_LOCAL uint8_t Storage::m_defaultSlots = 0;
+HELIOS_LOCAL uint8_t Storage::m_writeKey = STORAGE_KEY_NONE;
+HELIOS_LOCAL uint8_t Storage::m_writeStep = 0;
+HELIOS_LOCAL uint8_t Storage::m_writeTries = 0;
+HELIOS_LOCAL uint8_t Storage::m_writeCrc = 0;
+HELIOS_LOCAL uint8_t Storage::m_configCache[STORAGE_CONFIG_SIZE];
+
+#if STORAGE_MODE_CACHE == 1
+// the cached slots are packed back to back in slot order, they are loaded by init
+HELIOS_LOCAL uint8_t Storage::m_modeCache[STORAGE_MODE_CACHE_SIZE];
+HELIOS_LOCAL uint8_t Storage::m_cacheValid = 0;
+#ifdef HELIOS_EMBEDDED
+uint8_t Storage::m_suspendCrc = 0;
+bool Storage::m_suspended = false;
+#endif
+#endif
+
+// the slots are at the start of the lower half and the config works backwards
+// from the end of it so they can't be allowed to run into each other
+static_assert(NUM_MODE_SLOTS * SLOT_SIZE <= CONFIG_START_INDEX + 1 - STORAGE_CONFIG_SIZE,
+  "the mode slots and the config don't fit in storage");
+
+#if STORAGE_MODE_CACHE == 1
+// the offsets into the cache are single bytes
+static_assert(STORAGE_MODE_CACHE_SIZE <= 255, "the mode cache can hold at most 255 bytes");
+#endif
+
+#if STORAGE_WEAR_LEVELING == 1
+// the newest copy of each slot and the config, these are found by scan_log
+HELIOS_LOCAL uint8_t Storage::m_logIndex[NUM_LOG_KEYS];
+HELIOS_LOCAL uint8_t Storage::m_logHead = 0;
+HELIOS_LOCAL uint8_t Storage::m_logSeq = 0;
+// the record being written doesn't replace the newest copy of anything
+HELIOS_LOCAL uint8_t Storage::m_moveKey = STORAGE_KEY_NONE;
+HELIOS_LOCAL uint8_t Storage::m_moveSize = 0;
+HELIOS_LOCAL bool Storage::m_clearKey = false;
+
+// marks a slot or the config that has no copy in the log
+#define LOG_NONE STORAGE_KEY_NONE
+// the address of a record in the log
+#define LOG_RECORD_POS(record) (STORAGE_LOG_START + ((uint16_t)(record) * LOG_RECORD_SIZE))
 #endif
 
 bool Storage::init()
 {
+  // anything still staged goes to the storage it was saved into before
+  // that storage is read again
+  flush();
+#if STORAGE_MODE_CACHE == 1
+#ifdef HELIOS_EMBEDDED
+  // after waking up the cache is still in ram, so everything only has to
+  // be loaded from the eeprom again if the ram didn't survive the sleep
+  if (resume()) {
+    return true;
+  }
+#endif
+  // nothing is cached till the storage is read
+  m_cacheValid = 0;
+#endif
+  memset(m_configCache, 0, sizeof(m_configCache));
+  default_slot_table(m_configCache + STORAGE_SLOT_TABLE_INDEX);
 #ifdef HELIOS_CLI
   if (!m_enableStorage) {
     return true;
   }
-  // if the storage filename doesn't exist then create it
-  if (access(STORAGE_FILENAME, O_RDWR) != 0 && errno == ENOENT) {
-    // The file doesn't exist, so try creating it
-    FILE *f = fopen(STORAGE_FILENAME, "w+b");
-    if (!f) {
+  if (!m_storageImage) {
+    // open the storage file or create it if it doesn't exist
+    int fd = open(m_storageFile, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+      perror("Error opening storage file");
+      return false;
+    }
+    // if the file is new or too short then fill the rest of the storage with 0s
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size < EEPROM_SIZE && ftruncate(fd, EEPROM_SIZE) != 0)) {
       perror("Error creating storage file for write");
+      close(fd);
       return false;
     }
-    // fill the storage with 0s
-    for (uint32_t i = 0; i < STORAGE_SIZE; ++i){
-      uint8_t b = 0x0;
-      fwrite(&b, 1, sizeof(uint8_t), f);
+    // then map the storage into memory so reads and writes are just memory
+    // accesses, the mapping stays valid after the file is closed
+    void *image = mmap(nullptr, EEPROM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+      perror("Error mapping storage file");
+      return false;
     }
-    fclose(f);
+    m_mappedImage = (uint8_t *)image;
+    m_storageImage = m_mappedImage;
   }
 #endif
+#if STORAGE_WEAR_LEVELING == 1
+  scan_log();
+#endif
+#if STORAGE_LEGACY_MIGRATION == 1
+  migrate_legacy();
+#endif
+#if STORAGE_MODE_CACHE == 1
+  load_cache();
+#endif
+  load_config(m_configCache);
   return true;
 }
 
-bool Storage::read_pattern(uint8_t slot, Pattern &pat)
+#ifdef HELIOS_CLI
+void Storage::cleanup()
 {
-  uint8_t pos = slot * SLOT_SIZE;
-  if (!check_crc(pos)) {
-    return false;
+  flush();
+  if (!m_mappedImage) {
+    return;
   }
-  for (uint8_t i = 0; i < PATTERN_SIZE; ++i) {
-    ((uint8_t *)&pat)[i] = read_byte(pos + i);
+  // write the storage back out to the file
+  if (msync(m_mappedImage, EEPROM_SIZE, MS_SYNC) != 0) {
+    perror("Error flushing storage file");
   }
-  return true;
+  munmap(m_mappedImage, EEPROM_SIZE);
+  if (m_storageImage == m_mappedImage) {
+    m_storageImage = nullptr;
+  }
+  m_mappedImage = nullptr;
 }
+#endif
 
-void Storage::write_pattern(uint8_t slot, const Pattern &pat)
+bool Storage::read_pattern(uint8_t mode, Pattern &pat)
 {
-  uint8_t pos = slot * SLOT_SIZE;
-  for (uint8_t i = 0; i < PATTERN_SIZE; ++i) {
-    uint8_t val = ((uint8_t *)&pat)[i];
-    uint8_t target = pos + i;
-    write_byte(target, val);
+  uint8_t slot = mode_slot(mode);
+  // a slot that is staged hasn't made it to the eeprom yet
+  if (m_defaultSlots & (1 << slot)) {
+    Patterns::make_default(slot, pat);
+    return true;
+  }
+  if (m_pendingSlot == slot) {
+    return pat.unserialize(m_pendingData);
   }
-  write_crc(pos);
+#if STORAGE_MODE_CACHE == 1
+  // the cache holds the slots packed the same as the eeprom but they were
+  // already checked at init, anything that didn't fit is read below
+  if (m_cacheValid & (1 << slot)) {
+    return pat.unserialize(m_modeCache + cache_offset(slot));
+  }
+#endif
+  // read into a buffer so the pattern is untouched if the slot is corrupt
+  uint8_t buf[SLOT_DATA_SIZE];
+  return read_slot(slot_pos(slot), buf) && pat.unserialize(buf);
 }
 
-void Storage::copy_slot(uint8_t srcSlot, uint8_t dstSlot)
+void Storage::write_pattern(uint8_t mode, const Pattern &pat)
 {
-  uint8_t src = srcSlot * SLOT_SIZE;
-  uint8_t dst = dstSlot * SLOT_SIZE;
-  for (uint8_t i = 0; i < SLOT_SIZE; ++i) {
-    write_byte(dst + i, read_byte(src + i));
-  }
+  write_slot(mode_slot(mode), pat);
+}
+
+uint8_t Storage::mode_slot(uint8_t mode)
+{
+  return m_configCache[STORAGE_SLOT_TABLE_INDEX + mode];
+}
+
+void Storage::swap_modes(uint8_t mode1, uint8_t mode2)
+{
+  uint8_t config[STORAGE_CONFIG_SIZE];
+  copy_config(config);
+  uint8_t *table = config + STORAGE_SLOT_TABLE_INDEX;
+  uint8_t slot = table[mode1];
+  table[mode1] = table[mode2];
+  table[mode2] = slot;
+  save_config(config);
 }
 
 uint8_t Storage::read_config(uint8_t index)
 {
-  return read_byte(CONFIG_START_INDEX - index);
+  return m_configCache[index];
 }
 
 void Storage::write_config(uint8_t index, uint8_t val)
 {
-  write_byte(CONFIG_START_INDEX - index, val);
+  uint8_t config[STORAGE_CONFIG_SIZE];
+  copy_config(config);
+  config[index] = val;
+  save_config(config);
 }
 
-uint8_t Storage::crc8(uint8_t pos, uint8_t size)
+bool Storage::read_block(uint16_t pos, uint8_t *buf, uint8_t size)
 {
-  uint8_t hash = 33;  // A non-zero initial value
+  uint8_t crc = CRC8_INIT;
   for (uint8_t i = 0; i < size; ++i) {
-    hash = ((hash << 5) + hash) + read_byte(pos);
+    buf[i] = read_byte(pos + i);
+    crc = crc8(crc, buf[i]);
   }
-  return hash;
+  // the crc is the byte right after the block
+  return read_byte(pos + size) == crc;
 }
 
-uint8_t Storage::crc_pos(uint8_t pos)
+void Storage::reset_patterns()
 {
-  // crc the entire slot except last byte
-  return crc8(pos, PATTERN_SIZE);
+  if (!can_store()) {
+    return;
+  }
+  uint8_t config[STORAGE_CONFIG_SIZE];
+  copy_config(config);
+  default_slot_table(config + STORAGE_SLOT_TABLE_INDEX);
+  save_config(config);
+  // a save of another slot that is still staged is replaced by its default
+  // too, the slot it was in goes back to the eeprom as it was
+  if (m_writeKey != m_pendingSlot) {
+    m_pendingSlot = STORAGE_KEY_NONE;
+  }
+  m_defaultSlots = (1 << NUM_MODE_SLOTS) - 1;
+#if STORAGE_MODE_CACHE == 1
+  m_cacheValid = 0;
+#endif
 }
 
-uint8_t Storage::read_crc(uint8_t pos)
+uint8_t Storage::crc8(uint8_t crc, uint8_t data)
 {
-  // read the last byte of the slot
-  return read_byte(pos + PATTERN_SIZE);
+  crc ^= data;
+  crc = (uint8_t)(crc << 4) ^ CRC8_TABLE(crc >> 4);
+  crc = (uint8_t)(crc << 4) ^ CRC8_TABLE(crc >> 4);
+  return crc;
 }
 
-bool Storage::check_crc(uint8_t pos)
+#if STORAGE_MODE_CACHE == 1
+void Storage::load_cache()
 {
-  // compare the last byte to the calculated crc
-  return (read_crc(pos) == crc_pos(pos));
+  uint8_t buf[SLOT_DATA_SIZE];
+  for (uint8_t slot = 0; slot < NUM_MODE_SLOTS; ++slot) {
+    if (read_slot(slot_pos(slot), buf)) {
+      cache_slot(slot, buf, Pattern::serializedSize(buf));
+    }
+  }
 }
 
-void Storage::write_crc(uint8_t pos)
+void Storage::cache_slot(uint8_t slot, const uint8_t *buf, uint8_t size)
 {
-  // compare the last byte to the calculated crc
-  write_byte(pos + PATTERN_SIZE, crc_pos(pos));
+  uint8_t pos = cache_offset(slot);
+  uint8_t end = cache_offset(NUM_MODE_SLOTS);
+  // take the old copy out and close the gap, the slots after it move down
+  if (m_cacheValid & (1 << slot)) {
+    uint8_t oldSize = Pattern::serializedSize(m_modeCache + pos);
+    end -= oldSize;
+    memmove(m_modeCache + pos, m_modeCache + pos + oldSize, end - pos);
+    m_cacheValid &= ~(1 << slot);
+  }
+  // if the new copy doesn't fit the slot just isn't cached, it's still read
+  // from the eeprom like without the cache
+  if (end + size > STORAGE_MODE_CACHE_SIZE) {
+    return;
+  }
+  memmove(m_modeCache + pos + size, m_modeCache + pos, end - pos);
+  memcpy(m_modeCache + pos, buf, size);
+  m_cacheValid |= (1 << slot);
 }
 
-void Storage::write_byte(uint8_t address, uint8_t data)
+uint8_t Storage::cache_offset(uint8_t slot)
 {
+  uint8_t offset = 0;
+  for (uint8_t i = 0; i < slot; ++i) {
+    if (m_cacheValid & (1 << i)) {
+      offset += Pattern::serializedSize(m_modeCache + offset);
+    }
+  }
+  return offset;
+}
+
 #ifdef HELIOS_EMBEDDED
-  // reads out the byte of the eeprom first to see if it's different
-  // before writing out the byte -- this is faster than always writing
-  if (read_byte(address) == data) {
+void Storage::suspend()
+{
+  m_suspendCrc = cache_crc();
+  m_suspended = true;
+}
+
+bool Storage::resume()
+{
+  bool resumed = m_suspended && cache_crc() == m_suspendCrc;
+  m_suspended = false;
+  return resumed;
+}
+
+uint8_t Storage::cache_crc()
+{
+  uint8_t crc = CRC8_INIT;
+  for (uint8_t i = 0; i < STORAGE_MODE_CACHE_SIZE; ++i) {
+    crc = crc8(crc, m_modeCache[i]);
+  }
+  for (uint8_t i = 0; i < STORAGE_CONFIG_SIZE; ++i) {
+    crc = crc8(crc, m_configCache[i]);
+  }
+  crc = crc8(crc, m_cacheValid);
+#if STORAGE_WEAR_LEVELING == 1
+  // the log positions are loaded by init too
+  for (uint8_t i = 0; i < NUM_LOG_KEYS; ++i) {
+    crc = crc8(crc, m_logIndex[i]);
+  }
+  crc = crc8(crc, m_logHead);
+  crc = crc8(crc, m_logSeq);
+#endif
+  return crc;
+}
+#endif
+#endif
+
+bool Storage::read_slot(uint16_t pos, uint8_t *buf)
+{
+  uint8_t size = slot_size(pos);
+  return size && read_block(pos, buf, size);
+}
+
+void Storage::write_slot(uint8_t slot, const Pattern &pat)
+{
+  if (!can_store()) {
     return;
   }
-  internal_write(address, data);
-  // double check that shit
-  if (read_byte(address) != data) {
-    // do it again because eeprom is stupid
-    internal_write(address, data);
-    // god forbid it doesn't write again
+  // only one slot is staged at a time, the only way two different slots are
+  // saved that close together is a migration at init, so the first slot is
+  // just written out before the second is staged
+  if (m_pendingSlot != STORAGE_KEY_NONE && m_pendingSlot != slot) {
+    flush();
   }
-#else // HELIOS_CLI
-  if (!m_enableStorage) {
+  m_pendingSize = pat.serialize(m_pendingData);
+  m_pendingSlot = slot;
+  // the new pattern replaces a default that was never written
+  m_defaultSlots &= ~(1 << slot);
+#if STORAGE_MODE_CACHE == 1
+  cache_slot(slot, m_pendingData, m_pendingSize);
+#endif
+  if (m_writeKey == slot) {
+    restart_record();
+  }
+}
+
+uint8_t Storage::slot_size(uint16_t pos)
+{
+  // the header of the saved pattern says how many bytes follow it
+  uint8_t header[PATTERN_HEADER_SIZE];
+  for (uint8_t i = 0; i < PATTERN_HEADER_SIZE; ++i) {
+    header[i] = read_byte(pos + i);
+  }
+  return Pattern::serializedSize(header);
+}
+
+uint16_t Storage::slot_pos(uint8_t slot)
+{
+#if STORAGE_WEAR_LEVELING == 1
+  if (m_logIndex[slot] != LOG_NONE) {
+    return LOG_RECORD_POS(m_logIndex[slot]) + 2;
+  }
+#endif
+  return slot * SLOT_SIZE;
+}
+
+void Storage::load_config(uint8_t *config)
+{
+  uint8_t seen = 0;
+  for (uint8_t i = 0; i < STORAGE_CONFIG_SIZE; ++i) {
+    config[i] = read_byte(config_pos(i));
+    uint8_t slot = config[i];
+    if (i >= STORAGE_SLOT_TABLE_INDEX && slot < NUM_MODE_SLOTS) {
+      seen |= (1 << slot);
+    }
+  }
+  // there are as many entries as slots so if every slot was seen then
+  // each one was seen exactly once
+  if (seen != (uint8_t)((1 << NUM_MODE_SLOTS) - 1)) {
+    default_slot_table(config + STORAGE_SLOT_TABLE_INDEX);
+  }
+}
+
+void Storage::copy_config(uint8_t *config)
+{
+  memcpy(config, m_configCache, STORAGE_CONFIG_SIZE);
+}
+
+void Storage::save_config(const uint8_t *config)
+{
+  if (!can_store()) {
     return;
   }
-  FILE *f = fopen(STORAGE_FILENAME, "r+b");
-  if (!f) {
-    perror("Error opening storage file");
+  memcpy(m_configCache, config, STORAGE_CONFIG_SIZE);
+  if (m_writeKey == LOG_KEY_CONFIG) {
+    restart_record();
+  } else {
+    m_configDirty = true;
+  }
+}
+
+void Storage::default_slot_table(uint8_t *table)
+{
+  for (uint8_t mode = 0; mode < NUM_MODE_SLOTS; ++mode) {
+    table[mode] = mode;
+  }
+}
+
+uint16_t Storage::config_pos(uint8_t index)
+{
+#if STORAGE_WEAR_LEVELING == 1
+  if (m_logIndex[LOG_KEY_CONFIG] != LOG_NONE) {
+    return LOG_RECORD_POS(m_logIndex[LOG_KEY_CONFIG]) + 2 + index;
+  }
+#endif
+  // the config bytes in the lower half work backwards from the end
+  return CONFIG_START_INDEX - index;
+}
+
+#if STORAGE_WEAR_LEVELING == 1
+void Storage::scan_log()
+{
+  memset(m_logIndex, LOG_NONE, sizeof(m_logIndex));
+  m_logHead = 0;
+  m_logSeq = 0;
+  bool found = false;
+  for (uint8_t record = 0; record < NUM_LOG_RECORDS; ++record) {
+    uint16_t pos = LOG_RECORD_POS(record);
+    uint8_t key = read_byte(pos + 1);
+    // a record that was never written or didn't finish has no valid key
+    if (key >= NUM_LOG_KEYS) {
+      continue;
+    }
+    uint8_t size = (key == LOG_KEY_CONFIG) ? STORAGE_CONFIG_SIZE : slot_size(pos + 2);
+    uint8_t buf[SLOT_DATA_SIZE];
+    if (!size || !read_block(pos + 2, buf, size)) {
+      continue;
+    }
+    // the sequence numbers wrap around but the records in the log were all
+    // written within one trip around it, so the difference gives the order
+    uint8_t seq = read_byte(pos);
+    uint8_t newest = m_logIndex[key];
+    if (newest == LOG_NONE || (int8_t)(seq - read_byte(LOG_RECORD_POS(newest))) > 0) {
+      m_logIndex[key] = record;
+    }
+    // the next record goes after the newest record of all
+    if (!found || (int8_t)(seq - m_logSeq) >= 0) {
+      m_logHead = record;
+      m_logSeq = seq;
+      found = true;
+    }
+  }
+  if (found) {
+    m_logHead = (m_logHead + 1) % NUM_LOG_RECORDS;
+    m_logSeq++;
+  }
+}
+
+#endif
+
+bool Storage::can_store()
+{
+#ifdef HELIOS_CLI
+  // without storage nothing is saved
+  return m_enableStorage && m_storageImage;
+#else
+  return true;
+#endif
+}
+
+void Storage::service()
+{
+#ifdef HELIOS_EMBEDDED
+  // the eeprom takes 3.4ms to write a byte, till it's done the tick goes on
+  if (EECR & (1 << EEPE)) {
+    return;
+  }
+#endif
+  write_next();
+}
+
+void Storage::flush()
+{
+  while (write_next()) {
+    // each write waits for the one before it
+  }
+}
+
+bool Storage::busy()
+{
+  return m_writeKey != STORAGE_KEY_NONE || m_pendingSlot != STORAGE_KEY_NONE || m_configDirty || m_defaultSlots;
+}
+
+bool Storage::write_next()
+{
+  if (m_writeKey == STORAGE_KEY_NONE && !start_record()) {
+    return false;
+  }
+  do {
+    uint16_t address;
+    uint8_t data;
+    next_write(address, data);
+    // a byte that already matches doesn't need to be written, and if it was
+    // written twice and still didn't take then give up on it because eeprom
+    // is stupid, either way move on to the next byte without waiting
+    if (read_byte(address) != data && m_writeTries < 2) {
+      write_byte(address, data);
+      m_writeTries++;
+      return true;
+    }
+  } while (advance());
+  return true;
+}
+
+bool Storage::start_record()
+{
+  // a staged slot goes first so the pattern buffer is free again soonest
+  if (m_pendingSlot != STORAGE_KEY_NONE) {
+    begin_record(m_pendingSlot);
+    return true;
+  }
+  if (m_configDirty) {
+    m_configDirty = false;
+    begin_record(LOG_KEY_CONFIG);
+    return true;
+  }
+  for (uint8_t slot = 0; slot < NUM_MODE_SLOTS; ++slot) {
+    if (m_defaultSlots & (1 << slot)) {
+      Pattern pat;
+      Patterns::make_default(slot, pat);
+      write_slot(slot, pat);
+      begin_record(slot);
+      return true;
+    }
+  }
+  return false;
+}
+
+void Storage::begin_record(uint8_t key)
+{
+  m_writeKey = key;
+  m_writeStep = 0;
+  m_writeTries = 0;
+#if STORAGE_WEAR_LEVELING == 1
+  // whatever has its newest copy in the record is moved home byte by byte
+  // before anything is written over it, its reads come from the record till then
+  m_moveKey = LOG_NONE;
+  m_moveSize = 0;
+  m_clearKey = false;
+  uint16_t pos = LOG_RECORD_POS(m_logHead);
+  for (uint8_t i = 0; i < NUM_LOG_KEYS; ++i) {
+    if (m_logIndex[i] != m_logHead) {
+      continue;
+    }
+    m_moveKey = i;
+    // only the packed pattern and the crc after it need to move, the config
+    // at home has no crc
+    if (i == LOG_KEY_CONFIG) {
+      m_moveSize = STORAGE_CONFIG_SIZE;
+    } else {
+      m_moveSize = slot_size(pos + 2);
+      if (m_moveSize) {
+        m_moveSize++;
+      }
+    }
+    // if the record held the newest copy of something then clear the key, the
+    // copy is moved home and if the power goes out while the record is
+    // written it can't be mistaken for a newer copy. Otherwise the record only
+    // held an old copy and the newer copy in the log always wins over it, so
+    // the key is left alone and usually doesn't need to be written at all
+    m_clearKey = true;
+    if (!m_moveSize) {
+      // a corrupt copy has nothing worth moving
+      m_logIndex[i] = LOG_NONE;
+    }
+  }
+#endif
+  restart_record();
+}
+
+void Storage::restart_record()
+{
+  const uint8_t *data = (m_writeKey == LOG_KEY_CONFIG) ? m_configCache : m_pendingData;
+  uint8_t size = (m_writeKey == LOG_KEY_CONFIG) ? STORAGE_CONFIG_SIZE : m_pendingSize;
+  m_writeCrc = CRC8_INIT;
+  for (uint8_t i = 0; i < size; ++i) {
+    m_writeCrc = crc8(m_writeCrc, data[i]);
+  }
+#if STORAGE_WEAR_LEVELING == 1
+  // a move that is still going on finishes first, the data that was already
+  // written is only part of a record that never got its key so it's just
+  // written over after the key is cleared again
+  if (m_writeStep > m_moveSize) {
+    m_writeStep = m_moveSize;
+    m_writeTries = 0;
+    m_clearKey = true;
+  }
+#else
+  m_writeStep = 0;
+  m_writeTries = 0;
+#endif
+}
+
+uint8_t Storage::record_steps()
+{
+  if (m_writeKey == LOG_KEY_CONFIG) {
+#if STORAGE_WEAR_LEVELING == 1
+    // the move, the key that is cleared, the config and crc, the key and seq
+    return m_moveSize + 1 + STORAGE_CONFIG_SIZE + 1 + 2;
+#else
+    // the config bytes at home have no crc
+    return STORAGE_CONFIG_SIZE;
+#endif
+  }
+#if STORAGE_WEAR_LEVELING == 1
+  return m_moveSize + 1 + m_pendingSize + 1 + 2;
+#else
+  return m_pendingSize + 1;
+#endif
+}
+
+void Storage::next_write(uint16_t &address, uint8_t &data)
+{
+  uint8_t step = m_writeStep;
+  bool config = (m_writeKey == LOG_KEY_CONFIG);
+  uint8_t size = config ? STORAGE_CONFIG_SIZE : m_pendingSize;
+#if STORAGE_WEAR_LEVELING == 1
+  uint16_t pos = LOG_RECORD_POS(m_logHead);
+  if (step < m_moveSize) {
+    // the copy that is moved home still has its positions in the log
+    address = (m_moveKey == LOG_KEY_CONFIG) ? (uint16_t)(CONFIG_START_INDEX - step) : (uint16_t)(m_moveKey * SLOT_SIZE + step);
+    data = read_byte(pos + 2 + step);
+    return;
+  }
+  step -= m_moveSize;
+  if (step == 0) {
+    // a key that doesn't need clearing is written with what's already there
+    address = pos + 1;
+    data = m_clearKey ? LOG_NONE : read_byte(address);
     return;
   }
-  // Seek to the specified address
-  if (fseek(f, address, SEEK_SET) != 0) {
-    perror("Error opening storage file for write");
-    fclose(f);
+  step--;
+  if (step > size) {
+    // the key goes before the sequence number, until that is written the record
+    // is the oldest in the log so any other copy of the key still wins
+    address = (step == size + 1) ? pos + 1 : pos;
+    data = (step == size + 1) ? m_writeKey : m_logSeq;
     return;
   }
-  if (!fwrite((const void *)&data, sizeof(uint8_t), 1, f)) {
+  address = pos + 2 + step;
+#else
+  if (config) {
+    // the config bytes in the lower half work backwards from the end
+    address = CONFIG_START_INDEX - step;
+  } else {
+    address = (m_writeKey * SLOT_SIZE) + step;
+  }
+#endif
+  if (step < size) {
+    data = config ? m_configCache[step] : m_pendingData[step];
+  } else {
+    data = m_writeCrc;
+  }
+}
+
+bool Storage::advance()
+{
+  m_writeStep++;
+  m_writeTries = 0;
+#if STORAGE_WEAR_LEVELING == 1
+  // once the copy is home the key no longer has a copy in the log
+  if (m_moveSize && m_writeStep == m_moveSize) {
+    m_logIndex[m_moveKey] = LOG_NONE;
+  }
+#endif
+  if (m_writeStep < record_steps()) {
+    return true;
+  }
+#if STORAGE_WEAR_LEVELING == 1
+  m_logIndex[m_writeKey] = m_logHead;
+  m_logHead = (m_logHead + 1) % NUM_LOG_RECORDS;
+  m_logSeq++;
+#endif
+  if (m_writeKey == m_pendingSlot) {
+    m_pendingSlot = STORAGE_KEY_NONE;
+  }
+  m_writeKey = STORAGE_KEY_NONE;
+  return false;
+}
+
+#if STORAGE_LEGACY_MIGRATION == 1
+// the old saves were a copy of the pattern in memory: the 6 args, the flags,
+// the 6 colors of the palette and the number of colors, then a checksum
+#define LEGACY_PATTERN_SIZE 26
+#define LEGACY_SLOT_SIZE (LEGACY_PATTERN_SIZE + 1)
+#define LEGACY_FLAGS_INDEX 6
+#define LEGACY_PALETTE_INDEX 7
+#define LEGACY_NUM_COLORS_INDEX 25
+
+void Storage::migrate_legacy()
+{
+#if STORAGE_WEAR_LEVELING == 1
+  // anything in the log means the storage was already written in this format
+  for (uint8_t i = 0; i < NUM_LOG_KEYS; ++i) {
+    if (m_logIndex[i] != LOG_NONE) {
+      return;
+    }
+  }
+#endif
+  uint8_t buf[SLOT_DATA_SIZE];
+  for (uint8_t slot = 0; slot < NUM_MODE_SLOTS; ++slot) {
+    if (read_slot(slot * SLOT_SIZE, buf)) {
+      return;
+    }
+  }
+  // the slots are bigger now so the new slots overlap the old ones, going
+  // backwards each old slot is read before anything is written over it.
+  // The config bytes didn't move so they don't need to be touched
+  for (uint8_t slot = NUM_MODE_SLOTS; slot > 0; --slot) {
+    uint16_t pos = (slot - 1) * LEGACY_SLOT_SIZE;
+    // the old checksum only ever added up the first byte of the slot, it has
+    // to be worked out the same way to tell an old save from a blank one
+    uint8_t first = read_byte(pos);
+    uint8_t hash = 33;
+    for (uint8_t i = 0; i < LEGACY_PATTERN_SIZE; ++i) {
+      hash = ((hash << 5) + hash) + first;
+    }
+    uint8_t numColors = read_byte(pos + LEGACY_NUM_COLORS_INDEX);
+    if (read_byte(pos + LEGACY_PATTERN_SIZE) != hash || !numColors || numColors > NUM_COLOR_SLOTS) {
+      continue;
+    }
+    Pattern pat(read_byte(pos), read_byte(pos + 1), read_byte(pos + 2),
+      read_byte(pos + 3), read_byte(pos + 4), read_byte(pos + 5));
+    pat.setFlags(read_byte(pos + LEGACY_FLAGS_INDEX));
+    for (uint8_t i = 0; i < numColors; ++i) {
+      uint16_t color = pos + LEGACY_PALETTE_INDEX + (i * 3);
+      pat.colorset().addColor(RGBColor(read_byte(color), read_byte(color + 1), read_byte(color + 2)));
+    }
+    write_slot(slot - 1, pat);
+  }
+}
+#endif
+
+void Storage::write_byte(uint16_t address, uint8_t data)
+{
+#ifdef HELIOS_EMBEDDED
+  // the byte was already read out to see if it's different so the write is
+  // only started when it changes something, the writes aren't checked here
+  // because they take 3.4ms so the next write_next checks it instead
+  internal_write(address, data);
+#else // HELIOS_CLI
+  // the storage file is mapped into the storage image by init
+  if (!m_enableStorage || !m_storageImage) {
     return;
   }
-  fclose(f); // Close the file
+  m_storageImage[address] = data;
 #endif
 }
 
-uint8_t Storage::read_byte(uint8_t address)
+uint8_t Storage::read_byte(uint16_t address)
 {
 #ifdef HELIOS_EMBEDDED
   // do a three way read because the attiny85 eeprom basically doesn't work
@@ -175,37 +806,16 @@ uint8_t Storage::read_byte(uint8_t address)
   }
   return 0;
 #else
-  if (!m_enableStorage) {
+  // no storage image means there is no storage, just like an empty file
+  if (!m_enableStorage || !m_storageImage) {
     return 0;
   }
-  uint8_t val = 0;
-  if (access(STORAGE_FILENAME, O_RDONLY) != 0) {
-    return val;
-  }
-  FILE *f = fopen(STORAGE_FILENAME, "rb"); // Open file for reading in binary mode
-  if (!f) {
-		// this error is ok, just means no storage
-    //perror("Error opening file for read");
-    return val;
-  }
-  // Seek to the specified address
-  if (fseek(f, address, SEEK_SET) != 0) {
-    // error
-    perror("Failed to seek");
-    fclose(f);
-    return val;
-  }
-  // Read a byte of data
-  if (!fread(&val, sizeof(uint8_t), 1, f)) {
-    perror("Failed to read byte");
-  }
-  fclose(f); // Close the file
-  return val;
+  return m_storageImage[address];
 #endif
 }
 
 #ifdef HELIOS_EMBEDDED
-inline void Storage::internal_write(uint8_t address, uint8_t data)
+inline void Storage::internal_write(uint16_t address, uint8_t data)
 {
   while (EECR & (1<<EEPE)) {
     // Wait for completion of previous write
@@ -221,7 +831,7 @@ inline void Storage::internal_write(uint8_t address, uint8_t data)
   EECR |= (1<<EEPE);
 }
 
-inline uint8_t Storage::internal_read(uint8_t address)
+inline uint8_t Storage::internal_read(uint16_t address)
 {
   while (EECR & (1<<EEPE)) {
     // Wait for completion of previous write
@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include "HeliosConfig.h"
+#include "Pattern.h"
 
 // the index of the first config byte, the config bytes start at the end
 // then work their way backwards (so 'config index 0' is the last byte)
@@ -15,8 +16,25 @@
 #define STORAGE_GLOBAL_FLAG_INDEX 0
 #define STORAGE_CURRENT_MODE_INDEX 1
 #define STORAGE_BRIGHTNESS_INDEX 2
+// the slot index table, the slot that holds each mode
+#define STORAGE_SLOT_TABLE_INDEX 3
+// the number of config bytes
+#define STORAGE_CONFIG_SIZE (STORAGE_SLOT_TABLE_INDEX + NUM_MODE_SLOTS)
+
+// the slot table and the mode cache use a bit per slot
+#if NUM_MODE_SLOTS > 8
+#error "storage only has room for up to 8 mode slots"
+#endif
+
+// the initial value of the crc-8 of a block, this is not 0 so that a block
+// of all 0x00 or all 0xFF bytes (a blank eeprom) never has a matching crc
+#define CRC8_INIT 0xFF
 
-class Pattern;
+// the key of the config in the storage log, the slots are keyed by index
+#define LOG_KEY_CONFIG NUM_MODE_SLOTS
+#define NUM_LOG_KEYS (NUM_MODE_SLOTS + 1)
+// marks no slot or config being staged or written
+#define STORAGE_KEY_NONE 0xFF
 
 class Storage
 {
@@ -24,10 +42,16 @@ public:
 
   static bool init();
 
-  static bool read_pattern(uint8_t slot, Pattern &pat);
-  static void write_pattern(uint8_t slot, const Pattern &pat);
+  // read or write the pattern of a mode, this goes to whichever slot the
+  // slot table says holds that mode
+  static bool read_pattern(uint8_t mode, Pattern &pat);
+  static void write_pattern(uint8_t mode, const Pattern &pat);
 
-  static void copy_slot(uint8_t srcSlot, uint8_t dstSlot);
+  // the slot that holds a mode, a blank or corrupt slot table puts each
+  // mode in the slot of the same index
+  static uint8_t mode_slot(uint8_t mode);
+  // swap the slots of two modes, this only rewrites the slot table
+  static void swap_modes(uint8_t mode1, uint8_t mode2);
 
   static uint8_t read_config(uint8_t index);
   static void write_config(uint8_t index, uint8_t val);
@@ -41,29 +65,185 @@ public:
   static uint8_t read_brightness() { return read_config(STORAGE_BRIGHTNESS_INDEX); }
   static void write_brightness(uint8_t brightness) { write_config(STORAGE_BRIGHTNESS_INDEX, brightness); }
 
-  static uint8_t crc8(uint8_t pos, uint8_t size);
+  // put every mode back in the slot of the same index with the default
+  // pattern of that slot, the defaults are written out in the background
+  static void reset_patterns();
+
+  // read a block of bytes and the crc that follows it in one pass, the
+  // buffer is filled either way but only holds the block if the crc matches
+  static bool read_block(uint16_t pos, uint8_t *buf, uint8_t size);
+
+  // add one byte to a running crc-8, a crc starts at CRC8_INIT
+  static uint8_t crc8(uint8_t crc, uint8_t data);
+
+  // saves are staged in ram and written out a byte at a time by this, it's
+  // run every tick and never waits on the eeprom so the tick never stalls
+  static void service();
+  // write out everything that is still staged, this waits on the eeprom for
+  // each byte so it's only done before sleeping or shutting down
+  static void flush();
+  // whether anything staged still has to be written
+  static bool busy();
+
+#if defined(HELIOS_EMBEDDED) && STORAGE_MODE_CACHE == 1
+  // remember a checksum of the cache before sleeping, the ram is kept
+  // through power down so the next init only needs to check the cache
+  static void suspend();
+#endif
 
 #ifdef HELIOS_CLI
-  // toggle storage on/off
-  static void enableStorage(bool enabled) { m_enableStorage = enabled; }
+  // toggle storage on/off, anything staged is written out first
+  static void enableStorage(bool enabled) { flush(); m_enableStorage = enabled; }
+  // back the storage with an image in memory instead of the storage file,
+  // the image must be EEPROM_SIZE bytes, or nullptr to use the file again.
+  // Anything staged is written out to the old storage first
+  static void setStorageImage(uint8_t *image) { flush(); m_storageImage = image; }
+  // change the storage file from the default STORAGE_FILENAME, this must
+  // be done before init because that is when the file is mapped into memory
+  static void setStorageFile(const char *filename) { m_storageFile = filename; }
+  // flush the storage file and unmap it, if it was mapped
+  static void cleanup();
+  // the eeprom address of the newest copy of a slot, for the save parser
+  static uint16_t slotAddress(uint8_t slot) { return slot_pos(slot); }
 #endif
 private:
-  static uint8_t crc_pos(uint8_t pos);
-  static uint8_t read_crc(uint8_t pos);
-  static bool check_crc(uint8_t pos);
-  static void write_crc(uint8_t pos);
+  // read the saved pattern at a position and check the crc, or stage a
+  // pattern to be saved into a slot
+  static bool read_slot(uint16_t pos, uint8_t *buf);
+  static void write_slot(uint8_t slot, const Pattern &pat);
+  // the size of the saved pattern at a position without the crc, this is
+  // worked out from the header and is 0 if the header isn't valid
+  static uint8_t slot_size(uint16_t pos);
+
+  // the position of the newest copy of a slot and of the config
+  static uint16_t slot_pos(uint8_t slot);
+  static uint16_t config_pos(uint8_t index);
+
+  // read the config bytes, the slot table is checked and replaced with
+  // the default order if it doesn't hold every slot exactly once
+  static void load_config(uint8_t *config);
+  // the current config bytes, out of the cache if there is one
+  static void copy_config(uint8_t *config);
+  // stage the config bytes to be written out all at once
+  static void save_config(const uint8_t *config);
+  // each mode in the slot of the same index
+  static void default_slot_table(uint8_t *table);
+
+#if STORAGE_MODE_CACHE == 1
+  // read every slot into the mode cache
+  static void load_cache();
+  // update the cached copy of a slot that is about to be written, the slot
+  // is left out of the cache if there isn't room for it
+  static void cache_slot(uint8_t slot, const uint8_t *buf, uint8_t size);
+  // where the packed copy of a slot starts in the cache, or where it would
+  // go if it isn't cached
+  static uint8_t cache_offset(uint8_t slot);
+#ifdef HELIOS_EMBEDDED
+  // whether the cache made it through sleep since suspend, this only works once
+  static bool resume();
+  // the checksum of the cache and the rest of the state that init loads
+  static uint8_t cache_crc();
+#endif
+#endif
+
+  // whether saves are kept, there is nothing to save into without storage
+  static bool can_store();
 
-  static void write_byte(uint8_t address, uint8_t data);
-  static uint8_t read_byte(uint8_t address);
+#if STORAGE_LEGACY_MIGRATION == 1
+  // rewrite the slots of a save from before the storage format changed, this
+  // only does anything if nothing was saved in the current format yet
+  static void migrate_legacy();
+#endif
 
+#if STORAGE_WEAR_LEVELING == 1
+  // find the newest copy of each slot and the config in the log
+  static void scan_log();
+#endif
+
+  // start writing whatever is staged next, false if nothing is staged
+  static bool start_record();
+  // start writing the record of a slot or the config, with wear leveling
+  // anything that has its newest copy in the record that gets replaced is
+  // moved back to the lower half first
+  static void begin_record(uint8_t key);
+  // the slot or config changed again while it was being written so the
+  // data is started over, the record only becomes valid once it's finished
+  static void restart_record();
+  // the number of bytes the record being written takes, including the move
+  static uint8_t record_steps();
+  // the address and value of the next byte of the record being written
+  static void next_write(uint16_t &address, uint8_t &data);
+  // move on to the next byte of the record, false once it's finished
+  static bool advance();
+  // write the next byte of the staged saves that changes the eeprom, false
+  // once there is nothing left to write
+  static bool write_next();
+
+  static void write_byte(uint16_t address, uint8_t data);
+  static uint8_t read_byte(uint16_t address);
+
+#ifdef HELIOS_EMBEDDED
+  static inline uint8_t internal_read(uint16_t address);
+  static inline void internal_write(uint16_t address, uint8_t data);
+#endif
+
+  // the pattern of the slot that is staged to be saved, it's serialized the
+  // same as in the eeprom and reads of the slot come from here till it's written
+  static HELIOS_LOCAL uint8_t m_pendingData[SLOT_DATA_SIZE];
+  static HELIOS_LOCAL uint8_t m_pendingSlot;
+  static HELIOS_LOCAL uint8_t m_pendingSize;
+  // the config changed and has to be written once the writer is free
+  static HELIOS_LOCAL bool m_configDirty;
+  // a bit for each slot that still has to have its default pattern written
+  static HELIOS_LOCAL uint8_t m_defaultSlots;
+  // the slot or config being written, the byte of the record the writer is
+  // on and how many times that byte has been written
+  static HELIOS_LOCAL uint8_t m_writeKey;
+  static HELIOS_LOCAL uint8_t m_writeStep;
+  static HELIOS_LOCAL uint8_t m_writeTries;
+  // the crc of the data being written
+  static HELIOS_LOCAL uint8_t m_writeCrc;
+  // a copy of the config bytes, saves are staged so this is the only up to
+  // date copy of them till the config is written
+  static HELIOS_LOCAL uint8_t m_configCache[STORAGE_CONFIG_SIZE];
+
+#if STORAGE_MODE_CACHE == 1
+  // the serialized slots packed back to back without their crcs, in slot
+  // order, and a bit for each slot that is in there
+  static HELIOS_LOCAL uint8_t m_modeCache[STORAGE_MODE_CACHE_SIZE];
+  static HELIOS_LOCAL uint8_t m_cacheValid;
 #ifdef HELIOS_EMBEDDED
-  static inline uint8_t internal_read(uint8_t address);
-  static inline void internal_write(uint8_t address, uint8_t data);
+  // the checksum of the cache when it was suspended and whether it was
+  static uint8_t m_suspendCrc;
+  static bool m_suspended;
+#endif
+#endif
+
+#if STORAGE_WEAR_LEVELING == 1
+  // the record in the log with the newest copy of each slot and the config
+  static HELIOS_LOCAL uint8_t m_logIndex[NUM_LOG_KEYS];
+  // the next record to write and the sequence number it gets
+  static HELIOS_LOCAL uint8_t m_logHead;
+  static HELIOS_LOCAL uint8_t m_logSeq;
+  // the slot or config that had its newest copy in the record being written
+  // and is moved home first, how many bytes that is, and whether the key of
+  // the record has to be cleared before the new data goes in
+  static HELIOS_LOCAL uint8_t m_moveKey;
+  static HELIOS_LOCAL uint8_t m_moveSize;
+  static HELIOS_LOCAL bool m_clearKey;
 #endif
 
 #ifdef HELIOS_CLI
   // whether storage is enabled
-  static bool m_enableStorage;
+  static HELIOS_LOCAL bool m_enableStorage;
+  // the in-memory storage image, if there is one
+  static HELIOS_LOCAL uint8_t *m_storageImage;
+  // the storage file and the image of it that is mapped into memory
+  static HELIOS_LOCAL const char *m_storageFile;
+  static HELIOS_LOCAL uint8_t *m_mappedImage;
+
+  // the engine context swaps this state in and out
+  friend class EngineContext;
 #endif
 };
 
@@ -24,19 +24,29 @@ uint64_t start = 0;
 #endif
 
 // static members
-uint32_t Time::m_curTick = 0;
+HELIOS_LOCAL uint32_t Time::m_curTick = 0;
 // the last frame timestamp
-uint32_t Time::m_prevTime = 0;
+HELIOS_LOCAL uint32_t Time::m_prevTime = 0;
 
 #ifdef HELIOS_CLI
 // whether timestep is enabled, default enabled
-bool Time::m_enableTimestep = true;
+HELIOS_LOCAL bool Time::m_enableTimestep = true;
+// the deadline table, nothing is set till the timers report in
+HELIOS_LOCAL uint32_t Time::m_deadlines[TIME_DEADLINE_COUNT] = {0};
+HELIOS_LOCAL uint8_t Time::m_deadlineFlags = 0;
 #endif
 
 bool Time::init()
 {
   m_prevTime = microseconds();
   m_curTick = 0;
+#ifdef HELIOS_CLI
+  // the tick counter went back to 0 so the deadlines the timers reported are
+  // meaningless now, treat them all as right away till the timers report again
+  for (uint8_t i = 0; i < TIME_DEADLINE_COUNT; ++i) {
+    setDeadline(i, 0);
+  }
+#endif
   return true;
 }
 
@@ -88,6 +98,39 @@ ISR(TIMER0_OVF_vect) {
 }
 #endif
 
+#ifdef HELIOS_CLI
+void Time::setDeadline(uint8_t slot, uint32_t tick)
+{
+  m_deadlines[slot] = tick;
+  m_deadlineFlags |= (1 << slot);
+}
+
+void Time::clearDeadline(uint8_t slot)
+{
+  m_deadlineFlags &= ~(1 << slot);
+}
+
+uint32_t Time::nextDeadline()
+{
+  uint32_t next = UINT32_MAX;
+  for (uint8_t i = 0; i < TIME_DEADLINE_COUNT; ++i) {
+    if (!(m_deadlineFlags & (1 << i))) {
+      continue;
+    }
+    // time till the deadline (forward or backwards), any deadline that has
+    // already passed may still be about to hit so it counts as now
+    int32_t ticks = (int32_t)(int64_t)(m_deadlines[i] - m_curTick);
+    if (ticks <= 0) {
+      return 0;
+    }
+    if ((uint32_t)ticks < next) {
+      next = (uint32_t)ticks;
+    }
+  }
+  return next;
+}
+#endif
+
 uint32_t Time::microseconds()
 {
 #ifdef HELIOS_CLI
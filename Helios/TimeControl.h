@@ -9,6 +9,19 @@
 #define MS_TO_TICKS(ms) (uint32_t)(((uint32_t)(ms) * TICKRATE) / 1000)
 #define SEC_TO_TICKS(s) (uint32_t)((uint32_t)(s) * TICKRATE)
 
+#ifdef HELIOS_CLI
+// the slots of the deadline table, each timer that reports the tick it will
+// next hit on gets its own slot
+enum TimeDeadline : uint8_t
+{
+  // the blink timer of the pattern that is playing
+  TIME_DEADLINE_BLINK,
+
+  // the number of slots, also used by timers that don't report a deadline
+  TIME_DEADLINE_COUNT
+};
+#endif
+
 class Time
 {
   // private unimplemented constructor
@@ -41,17 +54,33 @@ public:
 #ifdef HELIOS_CLI
   // toggle timestep on/off
   static void enableTimestep(bool enabled) { m_enableTimestep = enabled; }
+  // jump the tick counter forward over ticks that don't need to be run
+  static void skipTicks(uint32_t ticks) { m_curTick += ticks; }
+
+  // set the tick that the timer in a slot of the deadline table will next
+  // hit on, or clear the slot if the timer won't hit until it is restarted
+  static void setDeadline(uint8_t slot, uint32_t tick);
+  static void clearDeadline(uint8_t slot);
+  // the number of ticks from now until the earliest deadline in the table,
+  // this is 0 if a deadline is now or was missed and UINT32_MAX if none are set
+  static uint32_t nextDeadline();
 #endif
 
 private:
   // global tick counter
-  static uint32_t m_curTick;
+  static HELIOS_LOCAL uint32_t m_curTick;
   // the last frame timestamp
-  static uint32_t m_prevTime;
+  static HELIOS_LOCAL uint32_t m_prevTime;
 
 #ifdef HELIOS_CLI
   // whether timestep is enabled
-  static bool m_enableTimestep;
+  static HELIOS_LOCAL bool m_enableTimestep;
+  // the deadline table and a bit for each slot that has a deadline set
+  static HELIOS_LOCAL uint32_t m_deadlines[TIME_DEADLINE_COUNT];
+  static HELIOS_LOCAL uint8_t m_deadlineFlags;
+
+  // the engine context swaps this state in and out
+  friend class EngineContext;
 #endif
 };
 
@@ -6,7 +6,10 @@
 
 Timer::Timer() :
   m_alarm(0),
-  m_startTime(0)
+  m_deadline(0)
+#ifdef HELIOS_CLI
+  , m_deadlineSlot(TIME_DEADLINE_COUNT)
+#endif
 {
 }
 
@@ -14,6 +17,23 @@ Timer::~Timer()
 {
 }
 
+#ifdef HELIOS_CLI
+Timer::Timer(const Timer &other) :
+  m_alarm(other.m_alarm),
+  m_deadline(other.m_deadline),
+  m_deadlineSlot(TIME_DEADLINE_COUNT)
+{
+}
+
+Timer &Timer::operator=(const Timer &other)
+{
+  // the slot stays with this timer
+  m_alarm = other.m_alarm;
+  m_deadline = other.m_deadline;
+  return *this;
+}
+#endif
+
 void Timer::init(uint8_t alarm)
 {
   reset();
@@ -23,14 +43,24 @@ void Timer::init(uint8_t alarm)
 
 void Timer::start(uint32_t offset)
 {
-  // reset the start time
-  m_startTime = Time::getCurtime() + offset;
+  // the first alarm hits one full alarm after the start
+  m_deadline = Time::getCurtime() + offset + m_alarm;
+#ifdef HELIOS_CLI
+  // the timer also hits on the tick it starts, so when that is still to
+  // come it is the next deadline rather than the first full alarm
+  publishDeadline(offset ? m_deadline - m_alarm : m_deadline);
+#endif
 }
 
 void Timer::reset()
 {
   m_alarm = 0;
-  m_startTime = 0;
+  m_deadline = 0;
+#ifdef HELIOS_CLI
+  if (m_deadlineSlot < TIME_DEADLINE_COUNT) {
+    Time::clearDeadline(m_deadlineSlot);
+  }
+#endif
 }
 
 bool Timer::alarm()
@@ -39,21 +69,40 @@ bool Timer::alarm()
     return false;
   }
   uint32_t now = Time::getCurtime();
-  // time since start (forward or backwards)
-  int32_t timeDiff = (int32_t)(int64_t)(now - m_startTime);
-  if (timeDiff < 0) {
-    return false;
-  }
-  // if no time passed it's first alarm that is starting
-  if (timeDiff == 0) {
+  // time past the deadline (forward or backwards)
+  int32_t late = (int32_t)(int64_t)(now - m_deadline);
+  if (late < 0) {
+    // the timer also hits on the tick it starts, which is one alarm before
+    // the deadline, otherwise the deadline just hasn't been reached yet
+    if ((late + (int32_t)m_alarm) != 0) {
+      return false;
+    }
+#ifdef HELIOS_CLI
+    publishDeadline(m_deadline);
+#endif
     return true;
   }
-  // if the current alarm duration is not a multiple of the current tick
-  if (m_alarm && (timeDiff % m_alarm) != 0) {
-    // then the alarm was not hit
-    return false;
+  // the deadline was reached so the next one is a full alarm later, unless
+  // the deadline was missed then step over all of the missed ones at once.
+  // That only happens when the timer wasn't checked for a while so the
+  // division is fine, the alarm only hits if a missed one lands right on now
+  bool hit = true;
+  if (late > 0) {
+    hit = ((uint32_t)late % m_alarm) == 0;
+    m_deadline += ((uint32_t)late / m_alarm) * m_alarm;
+  }
+  m_deadline += m_alarm;
+#ifdef HELIOS_CLI
+  publishDeadline(m_deadline);
+#endif
+  return hit;
+}
+
+#ifdef HELIOS_CLI
+void Timer::publishDeadline(uint32_t deadline) const
+{
+  if (m_deadlineSlot < TIME_DEADLINE_COUNT) {
+    Time::setDeadline(m_deadlineSlot, deadline);
   }
-  // update the start time of the timer
-  m_startTime = now;
-  return true;
 }
+#endif
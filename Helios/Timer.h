@@ -8,23 +8,42 @@ class Timer
 public:
   Timer();
   ~Timer();
+#ifdef HELIOS_CLI
+  // a copy of a timer doesn't report to the deadline table, only the timer
+  // that was told to with reportDeadline does
+  Timer(const Timer &other);
+  Timer &operator=(const Timer &other);
+#endif
 
   // init a timer with a number of alarms and optionally start it
   void init(uint8_t alarm);
 
   // start the timer but don't change current alarm, this shifts
-  // the timer startTime but does not reset it's alarm state
+  // the timer deadline but does not reset it's alarm state
   void start(uint32_t offset = 0);
   // delete all alarms from the timer and reset
   void reset();
   // Will return the true if the timer hit
   bool alarm();
 
+#ifdef HELIOS_CLI
+  // keep a slot of the deadline table in Time up to date with the tick
+  // this timer will next hit on so the engine can skip ahead to it
+  void reportDeadline(uint8_t slot) { m_deadlineSlot = slot; }
+  // update the slot in the deadline table if there is one
+  void publishDeadline(uint32_t deadline) const;
+#endif
+
 private:
+
   // the alarm
   uint32_t m_alarm;
-  // start time in microseconds
-  uint32_t m_startTime;
+  // the tick the alarm will next hit on
+  uint32_t m_deadline;
+#ifdef HELIOS_CLI
+  // the slot in the deadline table this timer reports to
+  uint8_t m_deadlineSlot;
+#endif
 };
 
 #endif
@@ -16,13 +16,16 @@
 #include <algorithm>
 #include <map>
 
+#include "PatternTimeline.h"
 #include "Helios.h"
 #include "TimeControl.h"
 #include "Storage.h"
 #include "Colortypes.h"
+#include "ColorBatch.h"
 #include "Button.h"
 #include "Led.h"
 #include "color_map.h"
+#include "save_parser.h"
 
 /*
  * TODO still:
@@ -36,31 +39,48 @@ enum OutputType {
   OUTPUT_TYPE_NONE,
   OUTPUT_TYPE_HEX,
   OUTPUT_TYPE_COLOR,
+  OUTPUT_TYPE_RLE,
 };
 
 // the default bmp filename
 #define DEFAULT_BMP_FILENAME "pattern.bmp"
-// the size of the whole EEPROM, only half is actually used
-#define EEPROM_SIZE 512
-
+// how many renders are held back and printed at once when the output isn't
+// being watched live, their brightness is adjusted as one batch
+#define SHOW_BATCH_SIZE 4096
 // various globals for the tool
 OutputType output_type = OUTPUT_TYPE_COLOR;
 std::string bmp_filename = DEFAULT_BMP_FILENAME;
 bool in_place = false;
 bool lockstep = false;
+bool show_layers = false;
 bool storage = false;
+std::string storage_file = STORAGE_FILENAME;
 bool timestep = true;
 bool eeprom = false;
 std::string eeprom_file;
+bool batch_saves = false;
+SaveFormat batch_format = SAVE_FORMAT_JSON;
+std::vector<std::string> batch_paths;
 bool generate_bmp = false;
+// the recorded colors, these are adjusted all at once when the bmp is written
 std::vector<RGBColor> colorBuffer;
+// the renders waiting to be printed, the color, the layer that drew it and
+// how many ticks it was shown for
+std::vector<RGBColor> shown_colors;
+std::vector<uint8_t> shown_layers;
+std::vector<uint32_t> shown_counts;
 uint32_t num_cycles = 0;
 float brightness_scale = 1.0f;
-uint8_t minumum_brightness = 75;
+// 0 leaves dim colors as they are
+uint8_t minimum_brightness = 0;
 std::string initial_colorset_str = "";
 std::string initial_pattern_str = "";
 std::string initial_pattern_args_str = "";
 uint32_t initial_mode_index = 0;
+// the run of the same color that is being counted in rle mode
+RGBColor rle_color;
+uint8_t rle_layer = LED_LAYER_PATTERN;
+uint32_t rle_count = 0;
 
 // used to switch terminal to non-blocking and back
 static struct termios orig_term_attr = {0};
@@ -68,14 +88,15 @@ static struct termios orig_term_attr = {0};
 // internal functions
 static void parse_options(int argc, char *argv[]);
 static bool read_inputs();
-static void show();
+static void show(uint32_t count = 1);
+static void flush_shown();
+static void print_color(RGBColor color, uint8_t layer, uint32_t count);
+static void adjust_brightness(std::vector<RGBColor> &colors);
+static void flush_rle();
 static void restore_terminal();
 static void set_terminal_nonblocking();
 static bool writeBMP(const std::string& filename, const std::vector<RGBColor>& colors);
 static void print_usage(const char* program_name);
-static bool parse_eep_file(const std::string& filename, std::vector<uint8_t>& memory);
-static bool parse_csv_hex(const std::string& filename, std::vector<uint8_t>& memory);
-static bool parse_bin_storage(const std::string& filename, std::vector<uint8_t>& memory);
 static void dump_eeprom(const std::string& filename);
 
 int main(int argc, char *argv[])
@@ -84,6 +105,10 @@ int main(int argc, char *argv[])
   parse_options(argc, argv);
   // set the terminal to instantly receive key presses
   set_terminal_nonblocking();
+  // parsing a batch of saves doesn't need helios either
+  if (batch_saves) {
+    return parse_saves(batch_paths, batch_format) ? 0 : 1;
+  }
   // if parsing an eeprom then no need to initialize helios
   if (eeprom_file.length() > 0) {
     // print out the contents of the eeprom file
@@ -94,6 +119,7 @@ int main(int argc, char *argv[])
   Time::enableTimestep(timestep);
   // toggle storage in the engine based on cli input
   Storage::enableStorage(storage);
+  Storage::setStorageFile(storage_file.c_str());
   // run the engine initialization
   Helios::init();
   // set the initial mode index
@@ -149,12 +175,24 @@ int main(int argc, char *argv[])
   }
   // just generate eeprom?
   if (eeprom) {
+    Storage::cleanup();
     return 0;
   }
-  // keep track of the number of cycles and the last colorset index each tick
-  // so that we can detect when one full cycle of the pattern has passed
-  uint32_t cycle_count = 0;
-  uint8_t last_index = 0;
+  // when cycling work out exactly which ticks to render from the timeline of
+  // the pattern, the transient before the pattern begins to repeat is skipped
+  // then exactly the requested number of periods are rendered after that
+  uint32_t cycle_start = 0;
+  uint32_t cycle_end = 0;
+  uint32_t cycle_tick = 0;
+  if (num_cycles > 0) {
+    // start the pattern fresh so that it plays the same as the timeline
+    Helios::cur_pattern().init();
+    PatternTimeline timeline(Helios::cur_pattern());
+    cycle_start = timeline.transient();
+    // a long period of a slow pattern can run past the last tick
+    uint64_t end = cycle_start + ((uint64_t)num_cycles * timeline.period());
+    cycle_end = (end > UINT32_MAX) ? UINT32_MAX : (uint32_t)end;
+  }
   while (Helios::keep_going()) {
     // check for any inputs and read the next one
     read_inputs();
@@ -164,34 +202,48 @@ int main(int argc, char *argv[])
       // just keep waiting for an input
       continue;
     }
-    // run the main loop
-    Helios::tick();
+    // without a timestep there's no need to actually run the ticks where
+    // nothing can change, so just jump over them and render them all at once
+    uint32_t num_ticks = 0;
+    if (!timestep && !lockstep) {
+      // don't jump over the start or end of the cycles though
+      uint32_t max_ticks = UINT32_MAX;
+      if (num_cycles > 0) {
+        max_ticks = (cycle_tick < cycle_start) ? (cycle_start - cycle_tick) : (cycle_end - cycle_tick);
+      }
+      num_ticks = Helios::fast_forward(max_ticks);
+    }
+    if (!num_ticks) {
+      // run the main loop
+      Helios::tick();
+      num_ticks = 1;
+    }
     // don't render anything if asleep, but technically it's still running...
     if (Helios::is_asleep()) {
       continue;
     }
-    // watch for a full cycle if it was requested by the command line
+    // only render the requested cycles if they were requested
     if (num_cycles > 0) {
-      // grab the current index of the colorset, which might be the same for
-      // several tick in a row, so we must check whether it just changed this
-      // tick by comparing it to the index we saved last tick
-      uint8_t cur_index = Helios::cur_pattern().colorset().curIndex();
-      if (cur_index == 0 && last_index != 0) {
-        // only if the current index is 0 (start of colorset) and the last index was
-        // not 0 then the colorset *just* started iterating through it's colors, so
-        // count this as +1 cycle in the cycle count
-        cycle_count++;
-      }
-      // then if we run more than the chosen number of cycles just quit
-      if (cycle_count >= num_cycles) {
+      // quit once the last tick of the last period has been rendered
+      if (cycle_tick >= cycle_end) {
         Helios::terminate();
         break;
       }
-      last_index = cur_index;
+      // don't render the transient before the pattern starts repeating
+      bool transient = (cycle_tick < cycle_start);
+      cycle_tick += num_ticks;
+      if (transient) {
+        continue;
+      }
     }
     // render the output of the main loop
-    show();
+    show(num_ticks);
   }
+  // print whatever renders and run were still waiting
+  flush_shown();
+  flush_rle();
+  // write out the storage file
+  Storage::cleanup();
   // if the user requested a bmp file to be written
   if (generate_bmp) {
     // if they didn't record anything give them a message indicating they need to record
@@ -200,6 +252,7 @@ int main(int argc, char *argv[])
       return 0;
     }
     std::cout << "Writing " << colorBuffer.size() << " colors to " << bmp_filename << std::endl;
+    adjust_brightness(colorBuffer);
     // try to write out however many colors they recorded to the bmp file
     if (!writeBMP(bmp_filename.c_str(), colorBuffer)) {
       // non-zero exit code means the utility failed it's job
@@ -210,6 +263,11 @@ int main(int argc, char *argv[])
   return 0;
 }
 
+// the long options that have no short option, these are past any character
+enum LongOption {
+  LONG_OPTION_STORAGE_FILE = 256,
+};
+
 // parse the command line options into global flags
 static void parse_options(int argc, char *argv[])
 {
@@ -218,11 +276,14 @@ static void parse_options(int argc, char *argv[])
   static struct option long_options[] = {
     {"hex", no_argument, nullptr, 'x'},
     {"color", no_argument, nullptr, 'c'},
+    {"rle", no_argument, nullptr, 'R'},
     {"quiet", no_argument, nullptr, 'q'},
     {"lockstep", no_argument, nullptr, 'l'},
     {"no-timestep", no_argument, nullptr, 't'},
     {"in-place", no_argument, nullptr, 'i'},
+    {"layers", no_argument, nullptr, 'L'},
     {"storage", no_argument, nullptr, 's'},
+    {"storage-file", required_argument, nullptr, LONG_OPTION_STORAGE_FILE},
     {"cycle", optional_argument, nullptr, 'y'},
     {"brightness-scale", required_argument, nullptr, 'a'},
     {"min-brightness", required_argument, nullptr, 'm'},
@@ -233,10 +294,11 @@ static void parse_options(int argc, char *argv[])
     {"bmp", optional_argument, nullptr, 'b'},
     {"eeprom", no_argument, nullptr, 'E'},
     {"parse-save", required_argument, nullptr, 'S'},
+    {"parse-saves", required_argument, nullptr, 'B'},
     {"help", no_argument, nullptr, 'h'},
     {nullptr, 0, nullptr, 0}
   };
-  while ((opt = getopt_long(argc, argv, "xcqltisyamC:P:A:I:b::ES:h", long_options, &option_index)) != -1) {
+  while ((opt = getopt_long(argc, argv, "xcRqltiLsyamC:P:A:I:b::ES:B:h", long_options, &option_index)) != -1) {
     switch (opt) {
     case 'x':
       // if the user wants pretty colors or hex codes
@@ -246,6 +308,10 @@ static void parse_options(int argc, char *argv[])
       // if the user wants pretty colors
       output_type = OUTPUT_TYPE_COLOR;
       break;
+    case 'R':
+      // if the user wants runs of hex codes
+      output_type = OUTPUT_TYPE_RLE;
+      break;
     case 'q':
       output_type = OUTPUT_TYPE_NONE;
       break;
@@ -261,10 +327,18 @@ static void parse_options(int argc, char *argv[])
       // if the user wants to print in-place (on one line)
       in_place = true;
       break;
+    case 'L':
+      // if the user wants to see which layer of the led drew each color
+      show_layers = true;
+      break;
     case 's':
-      // TODO: implement storage filename
       storage = true;
       break;
+    case LONG_OPTION_STORAGE_FILE:
+      // a storage file other than the default also turns on storage
+      storage = true;
+      storage_file = optarg;
+      break;
     case 'y':
       // set the number of cycles to default 1
       num_cycles = 1;
@@ -298,13 +372,8 @@ static void parse_options(int argc, char *argv[])
         optarg = argv[optind++];
       }
       if (optarg) {
-        minumum_brightness = strtoul(optarg, NULL, 100);
-      }
-      // allow brightness scale 0? probably not because it's most likely a mistake
-      // like wrong arguments and the brightness was passed a string, so just reset
-      // the brightness to 1.0 if it parsed as 0
-      if (!minumum_brightness) {
-        minumum_brightness = 75;
+        // a minimum of 0 is the same as not giving one
+        minimum_brightness = strtoul(optarg, NULL, 10);
       }
       break;
     case 'C':
@@ -341,6 +410,16 @@ static void parse_options(int argc, char *argv[])
     case 'S':
       eeprom_file = optarg;
       break;
+    case 'B':
+      // parse all of the files and directories after the options
+      batch_saves = true;
+      if (strcmp(optarg, "csv") == 0) {
+        batch_format = SAVE_FORMAT_CSV;
+      } else if (strcmp(optarg, "json") != 0) {
+        printf("Unknown save format: %s, only json or csv are supported\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
     case 'h':
       // print usage and exit
       print_usage(argv[0]);
@@ -350,6 +429,10 @@ static void parse_options(int argc, char *argv[])
       exit(EXIT_FAILURE);
     }
   }
+  // the rest of the args are the saves to parse
+  for (int i = optind; i < argc; ++i) {
+    batch_paths.push_back(argv[i]);
+  }
 }
 
 // read the input from stdin to control the tool
@@ -395,17 +478,68 @@ static bool read_inputs()
   return true;
 }
 
-// render the led
-static void show()
+// the name of a layer of the led for the --layers output
+static const char *layer_name(uint8_t layer)
+{
+  switch (layer) {
+  case LED_LAYER_MENU:
+    return "menu";
+  case LED_LAYER_SELECTION:
+    return "selection";
+  default:
+    return "pattern";
+  }
+}
+
+// render the led for some number of ticks it was the same for
+static void show(uint32_t count)
 {
+  RGBColor currentColor = {Led::get().red, Led::get().green, Led::get().blue};
+  if (generate_bmp) {
+    // record the color even if they have chosen the -q for quiet option, the
+    // brightness of the whole recording is adjusted at once when it's written
+    colorBuffer.insert(colorBuffer.end(), count, currentColor);
+  }
   if (output_type == OUTPUT_TYPE_NONE) {
-    if (generate_bmp) {
-      // still need to generate the BMP by recoring all the output colors
-      // even if they have chosen the -q for quiet option
-      RGBColor currentColor = {Led::get().red, Led::get().green, Led::get().blue};
-      RGBColor scaledColor = currentColor.scaleBrightness(brightness_scale);
-      colorBuffer.push_back(scaledColor);
+    return;
+  }
+  shown_colors.push_back(currentColor);
+  shown_layers.push_back(Led::getLayer());
+  shown_counts.push_back(count);
+  // with a timestep or lockstep someone is watching it play so each render is
+  // printed right away, otherwise they're printed a batch at a time
+  if (timestep || lockstep || shown_colors.size() >= SHOW_BATCH_SIZE) {
+    flush_shown();
+  }
+}
+
+// print the renders that are waiting
+static void flush_shown()
+{
+  if (shown_colors.empty()) {
+    return;
+  }
+  adjust_brightness(shown_colors);
+  for (size_t i = 0; i < shown_colors.size(); ++i) {
+    print_color(shown_colors[i], shown_layers[i], shown_counts[i]);
+  }
+  fflush(stdout);
+  shown_colors.clear();
+  shown_layers.clear();
+  shown_counts.clear();
+}
+
+// print one render of a color that was already adjusted
+static void print_color(RGBColor color, uint8_t layer, uint32_t count)
+{
+  if (output_type == OUTPUT_TYPE_RLE) {
+    // keep counting the run till the color (or the layer) changes then print it
+    if (rle_count > 0 && (color != rle_color || (show_layers && layer != rle_layer))) {
+      flush_rle();
     }
+    rle_color = color;
+    rle_layer = layer;
+    rle_count += count;
     return;
   }
   std::string out;
@@ -413,35 +547,65 @@ static void show()
     // this resets the cursor back to the beginning of the line
     out += "\r";
   }
-  // Get the current color and scale its brightness up
-  RGBColor currentColor = {Led::get().red, Led::get().green, Led::get().blue};
-  RGBColor scaledColor = currentColor.scaleBrightness(brightness_scale);
   if (output_type == OUTPUT_TYPE_COLOR) {
     out += "\x1B[0m["; // opening |
     out += "\x1B[48;2;"; // colorcode start
-    out += std::to_string(scaledColor.red) + ";"; // col red
-    out += std::to_string(scaledColor.green) + ";"; // col green
-    out += std::to_string(scaledColor.blue) + "m"; // col blue
+    out += std::to_string(color.red) + ";"; // col red
+    out += std::to_string(color.green) + ";"; // col green
+    out += std::to_string(color.blue) + "m"; // col blue
     out += "  "; // colored space
     out += "\x1B[0m]"; // ending |
   } else if (output_type == OUTPUT_TYPE_HEX) {
     // otherwise this just prints out the raw hex code if not in color mode
     for (uint32_t i = 0; i < output_type; ++i) {
       char buf[128] = { 0 };
-      snprintf(buf, sizeof(buf), "%02X%02X%02X", scaledColor.red, scaledColor.green, scaledColor.blue);
+      snprintf(buf, sizeof(buf), "%02X%02X%02X", color.red, color.green, color.blue);
       out += buf;
     }
   }
-  // if the engine
-  if (generate_bmp) {
-    // Add scaled color to buffer
-    colorBuffer.push_back(scaledColor);
+  if (show_layers) {
+    // the layer of the led that drew this color
+    out += " ";
+    out += layer_name(layer);
   }
   if (!in_place) {
     out += "\n";
   }
-  printf("%s", out.c_str());
+  for (uint32_t i = 0; i < count; ++i) {
+    fwrite(out.c_str(), 1, out.length(), stdout);
+  }
+}
+
+// scale the brightness of the output colors up then bring any that are too
+// dim up to the minimum brightness, if there is one
+static void adjust_brightness(std::vector<RGBColor> &colors)
+{
+  scale_brightness_batch(colors.data(), colors.data(), colors.size(), brightness_scale);
+  if (minimum_brightness) {
+    bring_up_brightness_batch(colors.data(), colors.data(), colors.size(), minimum_brightness);
+  }
+}
+
+// print the run of the same color that was counted in rle mode, each run is
+// the hex code of the color then x and the number of ticks, ex: FF0000x25
+// but a run of only one tick is just the hex code the same as hex mode, with
+// --layers the layer follows the run, ex: FF0000x25 menu
+static void flush_rle()
+{
+  if (!rle_count) {
+    return;
+  }
+  if (rle_count > 1) {
+    printf("%02X%02X%02Xx%u", rle_color.red, rle_color.green, rle_color.blue, rle_count);
+  } else {
+    printf("%02X%02X%02X", rle_color.red, rle_color.green, rle_color.blue);
+  }
+  if (show_layers) {
+    printf(" %s", layer_name(rle_layer));
+  }
+  printf("\n");
   fflush(stdout);
+  rle_count = 0;
 }
 
 // installed as an automatic exit handler to restore terminal behaviour
@@ -522,16 +686,12 @@ bool writeBMP(const std::string& filename, const std::vector<RGBColor>& colors)
   // write out the headers
   file.write((const char *)&bmpHeader, sizeof(bmpHeader));
   file.write((const char *)&dibHeader, sizeof(dibHeader));
-  // write out data
+  // write out data, each row is packed into BGR format with the padding
+  // bytes already zeroed at the end of it
+  std::vector<uint8_t> row(rowPaddedSize, 0);
   for (int32_t y = height - 1; y >= 0; --y) {
-    for (int32_t x = 0; x < width; ++x) {
-      const RGBColor& color = colors[y * width + x];
-      // BGR format
-      const unsigned char pixel[3] = { color.blue, color.green, color.red };
-      file.write((const char *)pixel, 3);
-    }
-    // write out extra padding bytes at end of row
-    file.write("\0\0\0", rowPaddedSize - (width * 3));
+    pack_bgr_batch(&colors[y * width], row.data(), width);
+    file.write((const char *)row.data(), rowPaddedSize);
   }
   if (!file.good()) {
     std::cerr << "Error writing to file: " << filename << std::endl;
@@ -547,16 +707,19 @@ static void print_usage(const char* program_name)
   fprintf(stderr, "Output Selection (at least one required):\n");
   fprintf(stderr, "  -x, --hex                Print hex values to represent led colors instead of color codes\n");
   fprintf(stderr, "  -c, --color              Print console color codes to represent led colors\n");
+  fprintf(stderr, "  -R, --rle                Print runs of hex values as color and ticks, ex: FF0000x25 (see expand_rle.py)\n");
   fprintf(stderr, "  -q, --quiet              Do not print anything, silently perform an operation\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Engine Control Flags (optional):\n");
   fprintf(stderr, "  -l, --lockstep           Only step once each time an input is received\n");
   fprintf(stderr, "  -t, --no-timestep        Run as fast as possible without managing timestep\n");
   fprintf(stderr, "  -i, --in-place           Print the output in-place (interactive mode)\n");
+  fprintf(stderr, "  -L, --layers             Print which layer of the led drew each color (pattern, menu or selection)\n");
   fprintf(stderr, "  -s, --storage            Enable persistent storage to file (" STORAGE_FILENAME ")\n");
-  fprintf(stderr, "  -y, --cycle [N]          Run N cycles of the first mode, default 1 (to gen pattern images)\n");
+  fprintf(stderr, "      --storage-file=FILE  Enable persistent storage to the given file instead\n");
+  fprintf(stderr, "  -y, --cycle [N]          Render exactly N periods of the first mode, default 1 (to gen pattern images)\n");
   fprintf(stderr, "  -a, --brightness-scale   Set the brightness scale of the output colors (default: 1.0, 2.0 is 100%% brighter)\n");
-  fprintf(stderr, "  -m, --min-brightness     Set the minimum brightness the output colors can be (default: 75)\n");
+  fprintf(stderr, "  -m, --min-brightness     Set the minimum brightness the output colors can be (default: off)\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Initial Pattern and Colorset (optional):\n");
   fprintf(stderr, "  -C, --colorset           Set the colorset of the first mode, ex: red,green,0x0000ff\n");
@@ -568,6 +731,8 @@ static void print_usage(const char* program_name)
   fprintf(stderr, "  -b, --bmp [file]         Specify a bitmap file to generate (default: " DEFAULT_BMP_FILENAME ")\n");
   fprintf(stderr, "  -E, --eeprom             Generate an eeprom file for flashing\n");
   fprintf(stderr, "  -S, --parse-save <file>  Parse an eeprom storage dump (supports .eep, .csv, and .storage formats)\n");
+  fprintf(stderr, "  -B, --parse-saves <fmt>  Parse every dump in the files and directories that follow into one\n");
+  fprintf(stderr, "                           record per device, the format is json (lines) or csv\n");
   fprintf(stderr, "  -h, --help               Display this help message\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Input Commands (pass to stdin):");
@@ -591,101 +756,7 @@ static void print_usage(const char* program_name)
   fprintf(stderr, "   ./helios -ci\n");
   fprintf(stderr, "   ./helios -cl <<< 300wcw300wcp1500wr300wq\n");
   fprintf(stderr, "   ./helios -S eeprom_dump.eep\n");
-}
-
-static bool parse_eep_file(const std::string& filename, std::vector<uint8_t>& memory)
-{
-  printf("Dumping EEPROM File: [%s]\n", filename.c_str());
-  std::ifstream infile(filename);
-  if (!infile.is_open()) {
-    printf("Failed to open file\n");
-    return false;
-  }
-
-  uint32_t baseAddress = 0;
-  std::string line;
-  while (std::getline(infile, line)) {
-    if (line[0] != ':') {
-      printf("Invalid start code\n");
-      return false;
-    }
-
-    int byteCount = std::stoi(line.substr(1, 2), nullptr, 16);
-    int address = std::stoi(line.substr(3, 4), nullptr, 16);
-    int recordType = std::stoi(line.substr(7, 2), nullptr, 16);
-
-    switch (recordType) {
-      case 0x00: // Data record
-        for (int i = 0; i < byteCount; ++i) {
-          int byte = std::stoi(line.substr(9 + i * 2, 2), nullptr, 16);
-          if (baseAddress + address + i < memory.size()) {
-            memory[baseAddress + address + i] = static_cast<uint8_t>(byte);
-          }
-        }
-        break;
-      case 0x02: // Extended segment address record
-        baseAddress = std::stoi(line.substr(9, 4), nullptr, 16) << 4;
-        break;
-      case 0x04: // Extended linear address record
-        baseAddress = std::stoi(line.substr(9, 4), nullptr, 16) << 16;
-        break;
-      case 0x01: // End of file record
-        break;
-      default:
-        // Unknown record type
-        break;
-    }
-  }
-
-  infile.close();
-  return true;
-}
-
-static bool parse_csv_hex(const std::string& filename, std::vector<uint8_t>& memory)
-{
-  std::ifstream file(filename);
-  if (!file.is_open()) {
-    printf("Failed to open file\n");
-    return false;
-  }
-
-  std::string line;
-  std::getline(file, line);
-  std::istringstream iss(line);
-  std::string token;
-
-  uint32_t pos = 0;
-  while (std::getline(iss, token, ',') && pos < EEPROM_SIZE) {
-    // Remove leading/trailing whitespace and "0x" prefix if present
-    token.erase(0, token.find_first_not_of(" \t"));
-    token.erase(token.find_last_not_of(" \t") + 1);
-    if (token.substr(0, 2) == "0x") {
-      token = token.substr(2);
-    }
-
-    // Convert hex string to integer
-    uint8_t value = std::stoi(token, nullptr, 16);
-    memory[pos] = value;
-    pos++;
-  }
-
-  return true;
-}
-
-static bool parse_bin_storage(const std::string& filename, std::vector<uint8_t>& memory)
-{
-  FILE *f = fopen(filename.c_str(), "rb"); // Open file for reading in binary mode
-  if (!f) {
-		// this error is ok, just means no storage
-    perror("Error opening file for read");
-    return false;
-  }
-  // Read a byte of data
-  if (!fread(&memory[0], sizeof(uint8_t), memory.size(), f)) {
-    perror("Failed to read data");
-  }
-  fclose(f); // Close the file
-  return true;
+  fprintf(stderr, "   ./helios -B json dumps/ > devices.jsonl\n");
 }
 
 static void dump_eeprom(const std::string& filename)
@@ -694,33 +765,32 @@ static void dump_eeprom(const std::string& filename)
     printf("Must provide an eeprom filename\n");
     return;
   }
-  std::vector<uint8_t> memory(EEPROM_SIZE, 0xFF); // Initialize memory with 0xFF
-  // Get file extension as lowercase
-  std::string extension = filename.substr(filename.find_last_of(".") + 1);
-  std::transform(extension.begin(), extension.end(), extension.begin(),
-      [](unsigned char c){ return std::tolower(c); });
-  bool parse_success;
-  if (extension == "eep") { // intel hex
-    parse_success = parse_eep_file(filename, memory);
-  } else if (extension == "csv") { // csv of hex bytes
-    parse_success = parse_csv_hex(filename, memory);
-  } else if (extension == "storage") { // raw binary (cli storage)
-    parse_success = parse_bin_storage(filename, memory);
-  } else {
-    printf("File format not supported, only .eep or .csv supported\n");
-    return;
-  }
-  if (!parse_success) {
-    printf("Failed to parse file\n");
+  printf("Dumping EEPROM File: [%s]\n", filename.c_str());
+  std::vector<char> contents;
+  std::vector<uint8_t> memory(EEPROM_SIZE);
+  const char *error = load_save(filename, contents, memory.data());
+  if (error) {
+    printf("Failed to parse file: %s\n", error);
     return;
   }
-  for (size_t slot = 0; slot < NUM_MODE_SLOTS; ++slot) {
-    size_t pos = slot * SLOT_SIZE;
-
+  // read the dump through the storage of the engine so that the newest copy
+  // of each slot is found whether it's in the log or the lower half
+  Storage::setStorageImage(memory.data());
+  Storage::init();
+  for (uint8_t mode = 0; mode < NUM_MODE_SLOTS; ++mode) {
+    // the slot table says which slot holds each mode, the newest copy of that
+    // slot is either in the lower half or in a record of the log
+    uint8_t slot = Storage::mode_slot(mode);
+    uint16_t address = Storage::slotAddress(slot);
+    printf("Mode %u (slot %u at 0x%03X in the %s):", mode, slot, address,
+        (address < STORAGE_LOG_START) ? "lower half" : "log");
     Pattern pat;
-    memcpy((void*)&pat, &memory[pos], sizeof(Pattern));
-
-    printf("Slot %zu:\n", slot);
+    if (!Storage::read_pattern(mode, pat)) {
+      // the slots are packed so there is no way to show an invalid one
+      printf(" invalid\n");
+      continue;
+    }
+    printf("\n");
     printf("  Colorset: ");
     for (size_t i = 0; i < pat.getColorset().numColors(); ++i) {
       RGBColor color = pat.getColorset()[i];
@@ -736,11 +806,11 @@ static void dump_eeprom(const std::string& filename)
     printf("  Flags: %02X\n", pat.getFlags());
   }
 
-  uint8_t flags = (uint8_t)memory[CONFIG_START_INDEX - STORAGE_GLOBAL_FLAG_INDEX];
+  uint8_t flags = Storage::read_global_flags();
   bool locked = (flags & Helios::FLAG_LOCKED) != 0;
   bool conjure = (flags & Helios::FLAG_CONJURE) != 0;
-  uint8_t modeIdx = (uint8_t)memory[CONFIG_START_INDEX - STORAGE_CURRENT_MODE_INDEX];
-  uint8_t brightness = (uint8_t)memory[CONFIG_START_INDEX - STORAGE_BRIGHTNESS_INDEX];
+  uint8_t modeIdx = Storage::read_current_mode();
+  uint8_t brightness = Storage::read_brightness();
 
   printf("Brightness: %u\n", brightness);
   printf("Mode Index: %u\n", modeIdx);
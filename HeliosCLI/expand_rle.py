@@ -0,0 +1,39 @@
+import argparse
+import re
+import sys
+
+# a run from helios --rle is a hex color then optionally x and the number of
+# ticks, ex: FF0000x25 or just FF0000 for a single tick, with --layers the
+# layer that drew the run follows it, ex: FF0000x25 menu
+RUN_PATTERN = re.compile(r"^([0-9A-Fa-f]{6})(?:x([0-9]+))?( [a-z]+)?$")
+
+def expand_lines(lines, out):
+    for line in lines:
+        stripped = line.rstrip("\r\n")
+        match = RUN_PATTERN.match(stripped)
+        if not match:
+            # anything that isn't a run (like a test file header) passes through
+            out.write(stripped + "\n")
+            continue
+        color = match.group(1) + (match.group(3) or "")
+        count = int(match.group(2)) if match.group(2) else 1
+        out.write((color + "\n") * count)
+
+def main():
+    parser = argparse.ArgumentParser(description="Expand helios --rle output back into one hex color per tick.")
+    parser.add_argument("input_file", type=str, nargs="?", help="Path to the rle output or test file (default: stdin)")
+    parser.add_argument("output_file", type=str, nargs="?", help="Path to the expanded output file (default: stdout)")
+    args = parser.parse_args()
+
+    infile = open(args.input_file, "r") if args.input_file else sys.stdin
+    outfile = open(args.output_file, "w") if args.output_file else sys.stdout
+    try:
+        expand_lines(infile, outfile)
+    finally:
+        if args.input_file:
+            infile.close()
+        if args.output_file:
+            outfile.close()
+
+if __name__ == "__main__":
+    main()
@@ -5,7 +5,7 @@ PATTERN_DIR=./default_patterns
 BMP_DIR=./bmp_patterns
 
 # Default values
-CYCLE_COUNT=2
+CYCLE_COUNT=1
 INPUT_COMMANDS="410wq"
 INCLUDE_GENERIC_FLASHING_PATTERNS=0
 NUM_PATTERNS=20
@@ -0,0 +1,451 @@
+#include "save_parser.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "HeliosConfig.h"
+#include "Storage.h"
+#include "Pattern.h"
+#include "Helios.h"
+
+// the most a record can take: the filename with every character escaped
+// as \u00XX plus the config and every mode with six colors
+#define SAVE_RECORD_SIZE ((PATH_MAX * 6) + 2048)
+
+// the record printed for a save, each thread formats its records into its
+// own buffer so that parsing a save doesn't allocate anything
+struct SaveRecord {
+  char data[SAVE_RECORD_SIZE];
+  size_t len;
+};
+
+static bool parse_intel_hex(const char *data, size_t size, uint8_t *memory);
+static bool parse_hex_list(const char *data, size_t size, uint8_t *memory);
+static bool read_file(const std::string &filename, std::vector<char> &contents);
+static bool has_save_extension(const std::string &filename, std::string *extension = nullptr);
+static void find_saves(const std::string &path, std::vector<std::string> &files);
+static void parse_save(const std::string &filename, SaveFormat format, SaveRecord &out,
+    std::vector<char> &contents, uint8_t *memory);
+static void append(SaveRecord &out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void append_char(SaveRecord &out, char c);
+static void append_quoted(SaveRecord &out, const std::string &str, SaveFormat format);
+
+// the value of a hex digit or -1 if it isn't one
+static inline int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// the value of two hex digits or -1 if they aren't both hex digits
+static inline int hex_byte(const char *str)
+{
+  int hi = hex_digit(str[0]);
+  int lo = hex_digit(str[1]);
+  if (hi < 0 || lo < 0) {
+    return -1;
+  }
+  return (hi << 4) | lo;
+}
+
+const char *load_save(const std::string &filename, std::vector<char> &contents, uint8_t *memory)
+{
+  std::string extension;
+  if (!has_save_extension(filename, &extension)) {
+    return "unsupported file format, only .eep, .csv or .storage are supported";
+  }
+  if (!read_file(filename, contents)) {
+    return "failed to read file";
+  }
+  // anything the dump doesn't cover is blank eeprom
+  memset(memory, 0xFF, EEPROM_SIZE);
+  if (extension == "eep") {
+    if (!parse_intel_hex(contents.data(), contents.size(), memory)) {
+      return "invalid intel hex";
+    }
+  } else if (extension == "csv") {
+    if (!parse_hex_list(contents.data(), contents.size(), memory)) {
+      return "invalid hex byte";
+    }
+  } else {
+    memcpy(memory, contents.data(), std::min(contents.size(), (size_t)EEPROM_SIZE));
+  }
+  return nullptr;
+}
+
+bool parse_saves(const std::vector<std::string> &paths, SaveFormat format)
+{
+  std::vector<std::string> files;
+  for (const std::string &path : paths) {
+    find_saves(path, files);
+  }
+  if (!files.size()) {
+    fprintf(stderr, "No .eep, .csv or .storage files to parse\n");
+    return false;
+  }
+  if (format == SAVE_FORMAT_CSV) {
+    printf("file,ok,error,brightness,mode_index,flags,valid_modes");
+    for (uint8_t mode = 0; mode < NUM_MODE_SLOTS; ++mode) {
+      printf(",mode%u", mode);
+    }
+    printf("\n");
+  }
+  // the storage state is thread local so each thread decodes its own saves
+  // through the engine storage, the file buffer, eeprom image and record
+  // buffer are reused from one save to the next
+  uint32_t numThreads = std::thread::hardware_concurrency();
+  if (!numThreads) {
+    numThreads = 1;
+  }
+  std::atomic<size_t> nextSave(0);
+  // the records are written straight out but in the order of the files, so
+  // each thread waits for the records before its own to be written first
+  std::mutex outputLock;
+  std::condition_variable outputTurn;
+  size_t nextOutput = 0;
+  auto worker = [&]() {
+    std::vector<char> contents;
+    uint8_t memory[EEPROM_SIZE];
+    SaveRecord record;
+    size_t index;
+    while ((index = nextSave.fetch_add(1)) < files.size()) {
+      record.len = 0;
+      parse_save(files[index], format, record, contents, memory);
+      std::unique_lock<std::mutex> lock(outputLock);
+      outputTurn.wait(lock, [&]() { return nextOutput == index; });
+      fwrite(record.data, 1, record.len, stdout);
+      nextOutput++;
+      outputTurn.notify_all();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (uint32_t i = 1; i < numThreads && i < files.size(); ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  return true;
+}
+
+static bool parse_intel_hex(const char *data, size_t size, uint8_t *memory)
+{
+  const char *end = data + size;
+  uint32_t baseAddress = 0;
+  while (data < end) {
+    // skip the line endings and any blank lines
+    if (*data == '\r' || *data == '\n' || *data == ' ' || *data == '\t') {
+      data++;
+      continue;
+    }
+    // a record is a start code then the count, address and type bytes
+    if (*data != ':' || end - data < 11) {
+      return false;
+    }
+    int count = hex_byte(data + 1);
+    int addrHi = hex_byte(data + 3);
+    int addrLo = hex_byte(data + 5);
+    int type = hex_byte(data + 7);
+    if (count < 0 || addrHi < 0 || addrLo < 0 || type < 0 || end - data < 11 + count * 2) {
+      return false;
+    }
+    const char *bytes = data + 9;
+    // every byte of the record adds up to 0 with the checksum at the end
+    uint8_t sum = count + addrHi + addrLo + type;
+    for (int i = 0; i <= count; ++i) {
+      int byte = hex_byte(bytes + i * 2);
+      if (byte < 0) {
+        return false;
+      }
+      sum += byte;
+    }
+    if (sum != 0) {
+      return false;
+    }
+    uint32_t address = baseAddress + ((addrHi << 8) | addrLo);
+    switch (type) {
+    case 0x00: // data record
+      for (int i = 0; i < count; ++i) {
+        if (address + i < EEPROM_SIZE) {
+          memory[address + i] = hex_byte(bytes + i * 2);
+        }
+      }
+      break;
+    case 0x02: // extended segment address record
+    case 0x04: // extended linear address record
+      if (count != 2) {
+        return false;
+      }
+      baseAddress = (hex_byte(bytes) << 8) | hex_byte(bytes + 2);
+      baseAddress <<= (type == 0x02) ? 4 : 16;
+      break;
+    case 0x01: // end of file record
+      return true;
+    default:
+      // unknown record types are skipped
+      break;
+    }
+    data = bytes + (count + 1) * 2;
+  }
+  return true;
+}
+
+static bool parse_hex_list(const char *data, size_t size, uint8_t *memory)
+{
+  const char *end = data + size;
+  uint32_t pos = 0;
+  while (data < end && pos < EEPROM_SIZE) {
+    // the bytes can be split up by commas and any amount of whitespace
+    if (*data == ',' || *data == ' ' || *data == '\t' || *data == '\r' || *data == '\n') {
+      data++;
+      continue;
+    }
+    if (end - data >= 2 && data[0] == '0' && (data[1] | 0x20) == 'x') {
+      data += 2;
+    }
+    // one or two hex digits make up each byte
+    int value = (data < end) ? hex_digit(*data++) : -1;
+    if (value < 0) {
+      return false;
+    }
+    if (data < end && hex_digit(*data) >= 0) {
+      value = (value << 4) | hex_digit(*data++);
+    }
+    memory[pos++] = value;
+  }
+  return true;
+}
+
+static bool read_file(const std::string &filename, std::vector<char> &contents)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  // resize only grows the buffer so it stops allocating after the largest file
+  contents.resize(st.st_size);
+  size_t total = 0;
+  while (total < contents.size()) {
+    ssize_t amount = read(fd, contents.data() + total, contents.size() - total);
+    if (amount <= 0) {
+      break;
+    }
+    total += amount;
+  }
+  close(fd);
+  contents.resize(total);
+  return true;
+}
+
+static bool has_save_extension(const std::string &filename, std::string *extension)
+{
+  size_t dot = filename.find_last_of('.');
+  if (dot == std::string::npos) {
+    return false;
+  }
+  std::string ext = filename.substr(dot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+      [](unsigned char c){ return std::tolower(c); });
+  if (ext != "eep" && ext != "csv" && ext != "storage") {
+    return false;
+  }
+  if (extension) {
+    *extension = ext;
+  }
+  return true;
+}
+
+static void find_saves(const std::string &path, std::vector<std::string> &files)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    fprintf(stderr, "Failed to open %s\n", path.c_str());
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    // a file that was named directly is always parsed, even if the
+    // format isn't supported, so that it gets a record saying so
+    files.push_back(path);
+    return;
+  }
+  DIR *dir = opendir(path.c_str());
+  if (!dir) {
+    fprintf(stderr, "Failed to open %s\n", path.c_str());
+    return;
+  }
+  // the directory is walked in sorted order so the output is the same each run
+  std::vector<std::string> entries;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      entries.push_back(path + "/" + entry->d_name);
+    }
+  }
+  closedir(dir);
+  std::sort(entries.begin(), entries.end());
+  for (const std::string &entry_path : entries) {
+    if (stat(entry_path.c_str(), &st) != 0) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      find_saves(entry_path, files);
+    } else if (has_save_extension(entry_path)) {
+      files.push_back(entry_path);
+    }
+  }
+}
+
+static void parse_save(const std::string &filename, SaveFormat format, SaveRecord &out,
+    std::vector<char> &contents, uint8_t *memory)
+{
+  bool json = (format == SAVE_FORMAT_JSON);
+  const char *error = load_save(filename, contents, memory);
+  if (json) {
+    append(out, "{\"file\":");
+  }
+  append_quoted(out, filename, format);
+  if (error) {
+    if (json) {
+      append(out, ",\"ok\":false,\"error\":");
+      append_quoted(out, error, format);
+      append(out, "}\n");
+    } else {
+      append(out, ",false,");
+      append_quoted(out, error, format);
+      append(out, ",,,,");
+      for (uint8_t mode = 0; mode < NUM_MODE_SLOTS; ++mode) {
+        append_char(out, ',');
+      }
+      append_char(out, '\n');
+    }
+    return;
+  }
+  // decode through the storage of the engine so the slot table and the newest
+  // copy of each slot in the log are found the same way the device finds them
+  Storage::setStorageImage(memory);
+  Storage::init();
+  uint8_t flags = Storage::read_global_flags();
+  uint8_t modeIdx = Storage::read_current_mode();
+  uint8_t brightness = Storage::read_brightness();
+  Pattern pats[NUM_MODE_SLOTS];
+  bool valid[NUM_MODE_SLOTS];
+  uint8_t numValid = 0;
+  for (uint8_t mode = 0; mode < NUM_MODE_SLOTS; ++mode) {
+    valid[mode] = Storage::read_pattern(mode, pats[mode]);
+    numValid += valid[mode];
+  }
+  if (json) {
+    append(out, ",\"ok\":true,\"brightness\":%u,\"mode_index\":%u,\"flags\":%u,\"locked\":%s,\"conjure\":%s,\"modes\":[",
+        brightness, modeIdx, flags,
+        (flags & Helios::FLAG_LOCKED) ? "true" : "false",
+        (flags & Helios::FLAG_CONJURE) ? "true" : "false");
+  } else {
+    append(out, ",true,,%u,%u,%u,%u", brightness, modeIdx, flags, numValid);
+  }
+  for (uint8_t mode = 0; mode < NUM_MODE_SLOTS; ++mode) {
+    const Pattern &pat = pats[mode];
+    uint8_t slot = Storage::mode_slot(mode);
+    Colorset set = pat.getColorset();
+    PatternArgs args = pat.getArgs();
+    if (json) {
+      uint16_t address = Storage::slotAddress(slot);
+      append(out, "%s{\"mode\":%u,\"slot\":%u,\"address\":%u,\"in_log\":%s,\"valid\":%s",
+          mode ? "," : "", mode, slot, address,
+          (address >= STORAGE_LOG_START) ? "true" : "false",
+          valid[mode] ? "true" : "false");
+      if (valid[mode]) {
+        append(out, ",\"colors\":[");
+        for (uint8_t i = 0; i < set.numColors(); ++i) {
+          RGBColor col = set.get(i);
+          append(out, "%s\"%02X%02X%02X\"", i ? "," : "", col.red, col.green, col.blue);
+        }
+        append(out, "],\"args\":[%u,%u,%u,%u,%u,%u],\"flags\":%u",
+            args.on_dur, args.off_dur, args.gap_dur, args.dash_dur, args.group_size,
+            args.blend_speed, (uint8_t)pat.getFlags());
+      }
+      append_char(out, '}');
+    } else {
+      // each mode is one column: the colors, the args then the flags
+      append_char(out, ',');
+      if (valid[mode]) {
+        for (uint8_t i = 0; i < set.numColors(); ++i) {
+          RGBColor col = set.get(i);
+          append(out, "%s%02X%02X%02X", i ? " " : "", col.red, col.green, col.blue);
+        }
+        append(out, ";%u %u %u %u %u %u;%u",
+            args.on_dur, args.off_dur, args.gap_dur, args.dash_dur, args.group_size,
+            args.blend_speed, (uint8_t)pat.getFlags());
+      }
+    }
+  }
+  append(out, "%s", json ? "]}\n" : "\n");
+  // the image is about to be reused for the next save
+  Storage::setStorageImage(nullptr);
+}
+
+static void append(SaveRecord &out, const char *fmt, ...)
+{
+  // the record is formatted in place, anything past the end is cut off
+  size_t room = sizeof(out.data) - out.len;
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(out.data + out.len, room, fmt, args);
+  va_end(args);
+  if (len > 0) {
+    out.len += std::min((size_t)len, room - 1);
+  }
+}
+
+static void append_char(SaveRecord &out, char c)
+{
+  if (out.len < sizeof(out.data) - 1) {
+    out.data[out.len++] = c;
+  }
+}
+
+static void append_quoted(SaveRecord &out, const std::string &str, SaveFormat format)
+{
+  append_char(out, '"');
+  for (char c : str) {
+    if (format == SAVE_FORMAT_CSV) {
+      // a quote in a csv field is doubled
+      if (c == '"') {
+        append_char(out, '"');
+      }
+      append_char(out, c);
+    } else if (c == '"' || c == '\\') {
+      append_char(out, '\\');
+      append_char(out, c);
+    } else if ((unsigned char)c < 0x20) {
+      append(out, "\\u%04x", c);
+    } else {
+      append_char(out, c);
+    }
+  }
+  append_char(out, '"');
+}
@@ -0,0 +1,28 @@
+#ifndef SAVE_PARSER_H
+#define SAVE_PARSER_H
+
+#include <inttypes.h>
+
+#include <string>
+#include <vector>
+
+// the formats a batch of parsed saves can be printed in
+enum SaveFormat {
+  // one json object per device on each line
+  SAVE_FORMAT_JSON,
+  // a header then one row per device
+  SAVE_FORMAT_CSV,
+};
+
+// read an eeprom dump (.eep intel hex, .csv of hex bytes or a raw .storage
+// file) into memory which must be EEPROM_SIZE bytes, the file is read into
+// contents which is reused from one call to the next so that nothing needs
+// to be allocated once it has grown. Returns why it failed or nullptr
+const char *load_save(const std::string &filename, std::vector<char> &contents, uint8_t *memory);
+
+// parse every save in a list of files and directories across all of the
+// cores and print one record per device in the order they were given,
+// returns false if there wasn't a single save to parse
+bool parse_saves(const std::vector<std::string> &paths, SaveFormat format);
+
+#endif
@@ -1,9 +1,21 @@
 #include "HeliosLib.h"
 
 // Helios includes
+#include "PatternTimeline.h"
+#include "EngineContext.h"
 #include "Helios.h"
+#include "Storage.h"
+#include "Button.h"
 #include "Led.h"
 
+#include <ctype.h>
+
+#ifndef WASM
+#include <atomic>
+#include <thread>
+#include <vector>
+#endif
+
 #ifdef WASM
 #include <emscripten/bind.h>
 #include <emscripten/val.h>
@@ -27,6 +39,13 @@ val tick_helios() {
   return color;
 }
 
+// render a batch of frames into a buffer allocated on the wasm heap by the
+// caller, this way there is one call per frame of a preview not one per tick
+static uint32_t render_frames_helios(uint32_t numFrames, uintptr_t buffer, std::string inputScript)
+{
+  return HeliosLib::renderFrames(numFrames, (uint8_t *)buffer, inputScript.c_str());
+}
+
 // js is dumb and has issues doing this cast I guess
 PatternID intToPatternID(int val)
 {
@@ -38,6 +57,7 @@ EMSCRIPTEN_BINDINGS(Vortex) {
   function("Init", &init_helios);
   function("Cleanup", &cleanup_helios);
   function("Tick", &tick_helios);
+  function("RenderFrames", &render_frames_helios);
 
   // Bind the HSVColor class
   class_<HSVColor>("HSVColor")
@@ -138,7 +158,13 @@ EMSCRIPTEN_BINDINGS(Vortex) {
     .function("setColorset", &Pattern::setColorset)
     .function("clearColorset", &Pattern::clearColorset)
     .function("getFlags", &Pattern::getFlags)
-    .function("hasFlags", &Pattern::hasFlags);
+    .function("hasFlags", &Pattern::hasFlags)
+    .function("colorAt", &Pattern::colorAt);
+
+  // pattern timeline class, for seeking through a pattern many times
+  class_<PatternTimeline>("PatternTimeline")
+    .constructor<const Pattern &>()
+    .function("colorAt", &PatternTimeline::colorAt);
 
   // bind others as necessary
 }
@@ -157,10 +183,98 @@ bool HeliosLib::init()
 
 void HeliosLib::cleanup()
 {
-
+  Storage::cleanup();
 }
 
 void HeliosLib::tick()
 {
   Helios::tick();
 }
+
+void HeliosLib::queueInputs(const char *inputScript)
+{
+  if (!inputScript) {
+    return;
+  }
+  const char *pos = inputScript;
+  while (*pos) {
+    // whitespace would block the input queue so just skip over it
+    if (isspace(*pos)) {
+      pos++;
+      continue;
+    }
+    // read a repeat amount if there is one, same as the cli
+    uint32_t repeatAmount = 1;
+    if (isdigit(*pos)) {
+      repeatAmount = 0;
+      while (isdigit(*pos)) {
+        repeatAmount = (repeatAmount * 10) + (*pos - '0');
+        pos++;
+      }
+      if (!*pos) {
+        break;
+      }
+    }
+    for (uint32_t i = 0; i < repeatAmount; ++i) {
+      Button::queueInput(*pos);
+    }
+    pos++;
+  }
+}
+
+uint32_t HeliosLib::renderFrames(uint32_t numFrames, uint8_t *buffer,
+  const char *inputScript)
+{
+  if (!buffer) {
+    return 0;
+  }
+  queueInputs(inputScript);
+  uint32_t frame = 0;
+  while (frame < numFrames && Helios::keep_going()) {
+    Helios::tick();
+    RGBColor col = Led::get();
+    buffer[0] = col.red;
+    buffer[1] = col.green;
+    buffer[2] = col.blue;
+    buffer += 3;
+    frame++;
+  }
+  return frame;
+}
+
+#ifndef WASM
+void HeliosLib::tickEngines(EngineContext *engines, uint32_t numEngines,
+  uint32_t numTicks, uint32_t numThreads)
+{
+    if (!engines || !numEngines) {
+        return;
+    }
+    if (!numThreads) {
+        numThreads = std::thread::hardware_concurrency();
+    }
+    if (!numThreads) {
+        numThreads = 1;
+    }
+    if (numThreads > numEngines) {
+        numThreads = numEngines;
+    }
+    // each worker grabs the next engine that hasn't been stepped yet, the
+    // engine state is thread local so each worker runs its own engine
+    std::atomic<uint32_t> nextEngine(0);
+    auto worker = [&]() {
+        uint32_t index;
+        while ((index = nextEngine.fetch_add(1)) < numEngines) {
+            engines[index].tick(numTicks);
+        }
+    };
+    // the calling thread does its share of the work too
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < numThreads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+#endif
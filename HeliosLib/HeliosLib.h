@@ -4,6 +4,11 @@
 // HeliosCLI would wrap this library to produce a CLI tool, but we already
 // wrapped the Helios core so we should abstract some of that logic to here and
 // simplify the CLI tool by just using this library directly
+
+#include <inttypes.h>
+
+class EngineContext;
+
 class HeliosLib
 {
 public:
@@ -11,5 +16,24 @@ public:
     static void cleanup();
 
     static void tick();
+
+    // queue a script of input commands for the button, these are the same
+    // commands as the cli takes like 'c' or '300w' and one runs per tick
+    static void queueInputs(const char *inputScript);
+
+    // queue an optional input script then run some ticks and write the color
+    // of the led after each tick into the buffer as packed rgb triples, so the
+    // buffer must hold numFrames * 3 bytes. Returns the number of frames that
+    // were rendered, which is less than requested if the engine terminates
+    static uint32_t renderFrames(uint32_t numFrames, uint8_t *buffer,
+      const char *inputScript = nullptr);
+
+#ifndef WASM
+    // step a batch of independent engines by some number of ticks each, the
+    // engines are spread across a pool of threads. If the number of threads
+    // is zero then one thread is used per hardware thread that is available
+    static void tickEngines(EngineContext *engines, uint32_t numEngines,
+      uint32_t numTicks, uint32_t numThreads = 0);
+#endif
 };
 
@@ -0,0 +1,292 @@
+// checks that the table driven and batch color conversions give exactly the
+// same colors as the math versions for every input then times each of them
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "Colortypes.h"
+#include "ColorBatch.h"
+
+// the makefile builds the color conversions with the alternative hsv to rgb
+// so the rainbow conversion is checked no matter what the engine uses
+#if ALTERNATIVE_HSV_RGB != 1
+#error "colorbench must be built with ALTERNATIVE_HSV_RGB=1"
+#endif
+
+// how many times each conversion is timed over all of its inputs
+#define BENCH_ROUNDS 4
+
+typedef RGBColor (*hsv_to_rgb_func)(const HSVColor &);
+typedef HSVColor (*rgb_to_hsv_func)(const RGBColor &);
+
+// every hsv value packed into a uint32
+#define NUM_HSV_VALUES (1u << 24)
+
+// the batch conversions are checked and timed this many colors at a time
+#define BATCH_SIZE (1u << 16)
+
+static bool check_hsv_to_rgb(const char *name, hsv_to_rgb_func math, hsv_to_rgb_func lut);
+static void bench_hsv_to_rgb(const char *name, hsv_to_rgb_func func);
+static bool check_rgb_to_hsv(const char *name, rgb_to_hsv_func math, rgb_to_hsv_func lut);
+static void bench_rgb_to_hsv(const char *name, rgb_to_hsv_func func);
+static bool check_batches();
+static void bench_batches();
+
+int main(int argc, char *argv[])
+{
+  bool success = true;
+  success &= check_hsv_to_rgb("hsv_to_rgb_generic", hsv_to_rgb_generic_math, hsv_to_rgb_generic_lut);
+  success &= check_hsv_to_rgb("hsv_to_rgb_rainbow", hsv_to_rgb_rainbow_math, hsv_to_rgb_rainbow_lut);
+  success &= check_rgb_to_hsv("rgb_to_hsv_generic", rgb_to_hsv_generic_math, rgb_to_hsv_generic_lut);
+  success &= check_batches();
+  if (!success) {
+    return 1;
+  }
+  bench_hsv_to_rgb("hsv_to_rgb_generic_math", hsv_to_rgb_generic_math);
+  bench_hsv_to_rgb("hsv_to_rgb_generic_lut", hsv_to_rgb_generic_lut);
+  bench_hsv_to_rgb("hsv_to_rgb_rainbow_math", hsv_to_rgb_rainbow_math);
+  bench_hsv_to_rgb("hsv_to_rgb_rainbow_lut", hsv_to_rgb_rainbow_lut);
+  bench_rgb_to_hsv("rgb_to_hsv_generic_math", rgb_to_hsv_generic_math);
+  bench_rgb_to_hsv("rgb_to_hsv_generic_lut", rgb_to_hsv_generic_lut);
+  bench_batches();
+  return 0;
+}
+
+static bool check_hsv_to_rgb(const char *name, hsv_to_rgb_func math, hsv_to_rgb_func lut)
+{
+  for (uint32_t i = 0; i < NUM_HSV_VALUES; ++i) {
+    HSVColor hsv(i);
+    RGBColor expected = math(hsv);
+    RGBColor actual = lut(hsv);
+    if (expected != actual) {
+      printf("%s: hsv %06X gave %06X instead of %06X\n", name, i, actual.raw(), expected.raw());
+      return false;
+    }
+  }
+  printf("%s: all %u colors match\n", name, NUM_HSV_VALUES);
+  return true;
+}
+
+static void bench_hsv_to_rgb(const char *name, hsv_to_rgb_func func)
+{
+  // the colors are summed up so the conversions can't be optimized out
+  uint32_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_RDTSC
+  uint64_t startCycles = __rdtsc();
+#endif
+  for (uint32_t round = 0; round < BENCH_ROUNDS; ++round) {
+    for (uint32_t i = 0; i < NUM_HSV_VALUES; ++i) {
+      sum += func(HSVColor(i)).raw();
+    }
+  }
+#ifdef HAVE_RDTSC
+  uint64_t cycles = __rdtsc() - startCycles;
+#endif
+  auto end = std::chrono::steady_clock::now();
+  double count = (double)NUM_HSV_VALUES * BENCH_ROUNDS;
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() / count;
+  printf("%-26s %6.2f ns", name, ns);
+#ifdef HAVE_RDTSC
+  printf("  %6.2f cycles", (double)cycles / count);
+#endif
+  printf("  per conversion (checksum %08X)\n", sum);
+}
+
+static bool check_rgb_to_hsv(const char *name, rgb_to_hsv_func math, rgb_to_hsv_func lut)
+{
+  for (uint32_t i = 0; i < NUM_HSV_VALUES; ++i) {
+    RGBColor rgb(i);
+    HSVColor expected = math(rgb);
+    HSVColor actual = lut(rgb);
+    if (expected != actual) {
+      printf("%s: rgb %06X gave %06X instead of %06X\n", name, i, actual.raw(), expected.raw());
+      return false;
+    }
+  }
+  printf("%s: all %u colors match\n", name, NUM_HSV_VALUES);
+  return true;
+}
+
+static void bench_rgb_to_hsv(const char *name, rgb_to_hsv_func func)
+{
+  uint32_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_RDTSC
+  uint64_t startCycles = __rdtsc();
+#endif
+  for (uint32_t round = 0; round < BENCH_ROUNDS; ++round) {
+    for (uint32_t i = 0; i < NUM_HSV_VALUES; ++i) {
+      sum += func(RGBColor(i)).raw();
+    }
+  }
+#ifdef HAVE_RDTSC
+  uint64_t cycles = __rdtsc() - startCycles;
+#endif
+  auto end = std::chrono::steady_clock::now();
+  double count = (double)NUM_HSV_VALUES * BENCH_ROUNDS;
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() / count;
+  printf("%-26s %6.2f ns", name, ns);
+#ifdef HAVE_RDTSC
+  printf("  %6.2f cycles", (double)cycles / count);
+#endif
+  printf("  per conversion (checksum %08X)\n", sum);
+}
+
+// print the first color that a batch got wrong, if there is one
+static bool check_batch(const char *name, const RGBColor *expected, const RGBColor *actual, uint32_t first)
+{
+  for (uint32_t i = 0; i < BATCH_SIZE; ++i) {
+    if (expected[i] != actual[i]) {
+      printf("%s: color %06X gave %06X instead of %06X\n", name, first + i, actual[i].raw(), expected[i].raw());
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool check_batches()
+{
+  std::vector<HSVColor> hsv(BATCH_SIZE), hsvOut(BATCH_SIZE);
+  std::vector<RGBColor> rgb(BATCH_SIZE), expected(BATCH_SIZE), actual(BATCH_SIZE);
+  // scales that round up, round down and clip
+  const float scales[] = { 0.0f, 0.3f, 0.5f, 1.0f, 1.5f, 2.0f, 3.7f, 255.0f };
+  const uint8_t minimums[] = { 1, 30, 128, 255 };
+  for (uint32_t first = 0; first < NUM_HSV_VALUES; first += BATCH_SIZE) {
+    for (uint32_t i = 0; i < BATCH_SIZE; ++i) {
+      hsv[i] = HSVColor(first + i);
+      rgb[i] = RGBColor(first + i);
+    }
+    // hsv to rgb with both algorithms, the rainbow one isn't done in lanes
+    const hsv_to_rgb_algorithm algs[] = { HSV_TO_RGB_GENERIC, HSV_TO_RGB_RAINBOW };
+    for (uint32_t a = 0; a < sizeof(algs) / sizeof(algs[0]); ++a) {
+      g_hsv_rgb_alg = algs[a];
+      for (uint32_t i = 0; i < BATCH_SIZE; ++i) {
+        expected[i] = hsv[i];
+      }
+      hsv_to_rgb_batch(hsv.data(), actual.data(), BATCH_SIZE);
+      if (!check_batch(a ? "hsv_to_rgb_batch (rainbow)" : "hsv_to_rgb_batch", expected.data(), actual.data(), first)) {
+        return false;
+      }
+    }
+    g_hsv_rgb_alg = HSV_TO_RGB_GENERIC;
+    // rgb to hsv, the hsv colors are compared as rgb colors of the same bytes
+    rgb_to_hsv_batch(rgb.data(), hsvOut.data(), BATCH_SIZE);
+    for (uint32_t i = 0; i < BATCH_SIZE; ++i) {
+      expected[i] = HSVColor(rgb[i]).raw();
+      actual[i] = hsvOut[i].raw();
+    }
+    if (!check_batch("rgb_to_hsv_batch", expected.data(), actual.data(), first)) {
+      return false;
+    }
+    // every channel of every color goes through the same brightness scale so
+    // all of the bytes are covered in the first batch
+    for (uint32_t s = 0; first == 0 && s < sizeof(scales) / sizeof(scales[0]); ++s) {
+      for (uint32_t i = 0; i < BATCH_SIZE; ++i) {
+        expected[i] = rgb[i].scaleBrightness(scales[s]);
+      }
+      scale_brightness_batch(rgb.data(), actual.data(), BATCH_SIZE, scales[s]);
+      if (!check_batch("scale_brightness_batch", expected.data(), actual.data(), first)) {
+        return false;
+      }
+    }
+    for (uint32_t m = 0; m < sizeof(minimums); ++m) {
+      for (uint32_t i = 0; i < BATCH_SIZE; ++i) {
+        expected[i] = rgb[i].bringUpBrightness(minimums[m]);
+      }
+      bring_up_brightness_batch(rgb.data(), actual.data(), BATCH_SIZE, minimums[m]);
+      if (!check_batch("bring_up_brightness_batch", expected.data(), actual.data(), first)) {
+        return false;
+      }
+    }
+    // the packed bytes are read back as colors with red and blue swapped
+    pack_bgr_batch(rgb.data(), (uint8_t *)actual.data(), BATCH_SIZE);
+    for (uint32_t i = 0; i < BATCH_SIZE; ++i) {
+      expected[i] = RGBColor(rgb[i].blue, rgb[i].green, rgb[i].red);
+    }
+    if (!check_batch("pack_bgr_batch", expected.data(), actual.data(), first)) {
+      return false;
+    }
+  }
+  // the batches that don't fill the last set of lanes
+  for (uint32_t count = 0; count < 40; ++count) {
+    std::vector<RGBColor> colors(count), scaled(count), lifted(count);
+    std::vector<uint8_t> packed(count * 3);
+    for (uint32_t i = 0; i < count; ++i) {
+      colors[i] = RGBColor((i * 0x2F6B3D) & 0xFFFFFF);
+    }
+    scale_brightness_batch(colors.data(), scaled.data(), count, 1.5f);
+    bring_up_brightness_batch(colors.data(), lifted.data(), count, 100);
+    pack_bgr_batch(colors.data(), packed.data(), count);
+    for (uint32_t i = 0; i < count; ++i) {
+      if (scaled[i] != colors[i].scaleBrightness(1.5f) || lifted[i] != colors[i].bringUpBrightness(100) ||
+          packed[i * 3] != colors[i].blue || packed[i * 3 + 1] != colors[i].green || packed[i * 3 + 2] != colors[i].red) {
+        printf("batch of %u: color %u doesn't match\n", count, i);
+        return false;
+      }
+    }
+  }
+  printf("batch conversions: all %u colors match\n", NUM_HSV_VALUES);
+  return true;
+}
+
+// time one batch conversion against doing each color one at a time
+#define BENCH_BATCH(name, single, batch)                                          \
+  do {                                                                            \
+    auto start = std::chrono::steady_clock::now();                                \
+    for (uint32_t round = 0; round < BENCH_ROUNDS; ++round) {                      \
+      for (uint32_t first = 0; first < NUM_HSV_VALUES; first += BATCH_SIZE) {      \
+        single;                                                                   \
+        sum += out[first / BATCH_SIZE].raw();                                          \
+      }                                                                           \
+    }                                                                             \
+    auto mid = std::chrono::steady_clock::now();                                  \
+    for (uint32_t round = 0; round < BENCH_ROUNDS; ++round) {                      \
+      for (uint32_t first = 0; first < NUM_HSV_VALUES; first += BATCH_SIZE) {      \
+        batch;                                                                    \
+        sum += out[first / BATCH_SIZE].raw();                                          \
+      }                                                                           \
+    }                                                                             \
+    auto end = std::chrono::steady_clock::now();                                  \
+    double count = (double)NUM_HSV_VALUES * BENCH_ROUNDS;                         \
+    printf("%-26s %6.2f ns single  %6.2f ns batch  per color\n", name,            \
+           std::chrono::duration<double, std::nano>(mid - start).count() / count,  \
+           std::chrono::duration<double, std::nano>(end - mid).count() / count);   \
+  } while (0)
+
+static void bench_batches()
+{
+  std::vector<RGBColor> in(BATCH_SIZE), out(BATCH_SIZE);
+  std::vector<HSVColor> hsv(BATCH_SIZE);
+  std::vector<uint8_t> packed(BATCH_SIZE * 3);
+  for (uint32_t i = 0; i < BATCH_SIZE; ++i) {
+    in[i] = RGBColor((i * 0x2F6B3D) & 0xFFFFFF);
+    hsv[i] = HSVColor((i * 0x2F6B3D) & 0xFFFFFF);
+  }
+  // the colors are summed up so the conversions can't be optimized out
+  uint32_t sum = 0;
+  BENCH_BATCH("hsv_to_rgb_batch",
+    for (uint32_t i = 0; i < BATCH_SIZE; ++i) out[i] = hsv[i],
+    hsv_to_rgb_batch(hsv.data(), out.data(), BATCH_SIZE));
+  BENCH_BATCH("rgb_to_hsv_batch",
+    for (uint32_t i = 0; i < BATCH_SIZE; ++i) hsv[i] = in[i]; out[0] = hsv[first / BATCH_SIZE].raw(),
+    rgb_to_hsv_batch(in.data(), hsv.data(), BATCH_SIZE); out[0] = hsv[first / BATCH_SIZE].raw());
+  BENCH_BATCH("scale_brightness_batch",
+    for (uint32_t i = 0; i < BATCH_SIZE; ++i) out[i] = in[i].scaleBrightness(1.5f),
+    scale_brightness_batch(in.data(), out.data(), BATCH_SIZE, 1.5f));
+  BENCH_BATCH("bring_up_brightness_batch",
+    for (uint32_t i = 0; i < BATCH_SIZE; ++i) out[i] = in[i].bringUpBrightness(100),
+    bring_up_brightness_batch(in.data(), out.data(), BATCH_SIZE, 100));
+  BENCH_BATCH("pack_bgr_batch",
+    for (uint32_t i = 0; i < BATCH_SIZE; ++i) { packed[i * 3] = in[i].blue; packed[i * 3 + 1] = in[i].green;
+      packed[i * 3 + 2] = in[i].red; } out[0] = RGBColor(packed[first / BATCH_SIZE], 0, 0),
+    pack_bgr_batch(in.data(), packed.data(), BATCH_SIZE); out[0] = RGBColor(packed[first / BATCH_SIZE], 0, 0));
+  printf("(checksum %08X)\n", sum);
+}
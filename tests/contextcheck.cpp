@@ -0,0 +1,206 @@
+// checks that engine contexts are isolated from each other and from the
+// engine of the calling thread, each engine is given its own storage, either
+// an image or a file, and whatever one engine saves or plays must never show
+// up in another engine
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "EngineContext.h"
+#include "TimeControl.h"
+#include "Patterns.h"
+#include "Storage.h"
+#include "Pattern.h"
+
+// how many ticks the engines are played side by side
+#define CHECK_TICKS 5000
+
+// the brightness and pattern each engine saves
+#define BRIGHTNESS_A 10
+#define BRIGHTNESS_B 200
+#define PATTERN_A PATTERN_STROBE
+#define PATTERN_B PATTERN_DOPS
+
+static void save_mode(EngineContext &engine, uint8_t brightness, PatternID id);
+static bool check_mode(EngineContext &engine, uint8_t brightness, PatternID id, const char *name);
+static bool check_images();
+static bool check_files();
+static bool check_ticks();
+
+int main()
+{
+  // the calling thread has an engine of its own with its own storage image,
+  // none of the contexts are allowed to touch it
+  static uint8_t thread_image[EEPROM_SIZE];
+  Time::enableTimestep(false);
+  Storage::setStorageImage(thread_image);
+  Storage::init();
+  Storage::write_brightness(BRIGHTNESS_A + BRIGHTNESS_B);
+  Storage::flush();
+  uint8_t thread_copy[EEPROM_SIZE];
+  memcpy(thread_copy, thread_image, sizeof(thread_copy));
+
+  bool success = check_images() && check_files() && check_ticks();
+
+  if (memcmp(thread_copy, thread_image, sizeof(thread_copy)) != 0 ||
+      Storage::read_brightness() != BRIGHTNESS_A + BRIGHTNESS_B) {
+    printf("the storage of the calling thread was changed by a context\n");
+    success = false;
+  }
+  if (!success) {
+    return 1;
+  }
+  printf("engine contexts are isolated\n");
+  return 0;
+}
+
+// save a brightness and the pattern of the first mode from inside an engine
+static void save_mode(EngineContext &engine, uint8_t brightness, PatternID id)
+{
+  Pattern pat;
+  Patterns::make_pattern(id, pat);
+  engine.exchange();
+  Storage::write_brightness(brightness);
+  Storage::write_pattern(0, pat);
+  engine.exchange();
+}
+
+// check the brightness and the pattern of the first mode of an engine
+static bool check_mode(EngineContext &engine, uint8_t brightness, PatternID id, const char *name)
+{
+  Pattern expected;
+  Patterns::make_pattern(id, expected);
+  Pattern pat;
+  engine.exchange();
+  uint8_t saved = Storage::read_brightness();
+  bool found = Storage::read_pattern(0, pat);
+  engine.exchange();
+  // the patterns are compared by what they save
+  uint8_t expected_buf[SLOT_DATA_SIZE];
+  uint8_t buf[SLOT_DATA_SIZE];
+  uint8_t size = expected.serialize(expected_buf);
+  if (saved != brightness || !found || pat.serialize(buf) != size ||
+      memcmp(buf, expected_buf, size) != 0) {
+    printf("%s doesn't hold what it saved (brightness %u, expected %u)\n",
+      name, saved, brightness);
+    return false;
+  }
+  return true;
+}
+
+// two engines that each save into their own image
+static bool check_images()
+{
+  EngineContext a;
+  EngineContext b;
+  if (!a.init() || !b.init()) {
+    printf("failed to init the engines\n");
+    return false;
+  }
+  save_mode(a, BRIGHTNESS_A, PATTERN_A);
+  save_mode(b, BRIGHTNESS_B, PATTERN_B);
+  if (!check_mode(a, BRIGHTNESS_A, PATTERN_A, "image a") ||
+      !check_mode(b, BRIGHTNESS_B, PATTERN_B, "image b")) {
+    return false;
+  }
+  // and once it's written out what an engine saved is all in its image, a
+  // fresh engine started on a copy of it finds the same thing
+  a.exchange();
+  Storage::flush();
+  a.exchange();
+  EngineContext c;
+  memcpy(c.storage(), a.storage(), EEPROM_SIZE);
+  if (!c.init()) {
+    printf("failed to init the engine\n");
+    return false;
+  }
+  return check_mode(c, BRIGHTNESS_A, PATTERN_A, "copy of image a");
+}
+
+// two engines that each save into their own file
+static bool check_files()
+{
+  char path_a[] = "/tmp/contextcheckXXXXXX";
+  char path_b[] = "/tmp/contextcheckXXXXXX";
+  int fd_a = mkstemp(path_a);
+  int fd_b = mkstemp(path_b);
+  if (fd_a < 0 || fd_b < 0) {
+    perror("Error creating storage files");
+    return false;
+  }
+  close(fd_a);
+  close(fd_b);
+  bool success = true;
+  {
+    EngineContext a;
+    EngineContext b;
+    a.setStorageFile(path_a);
+    b.setStorageFile(path_b);
+    if (!a.init() || !b.init()) {
+      printf("failed to init the engines\n");
+      success = false;
+    } else {
+      save_mode(a, BRIGHTNESS_A, PATTERN_A);
+      save_mode(b, BRIGHTNESS_B, PATTERN_B);
+      success = check_mode(a, BRIGHTNESS_A, PATTERN_A, "file a") &&
+        check_mode(b, BRIGHTNESS_B, PATTERN_B, "file b");
+    }
+    // the files are unmapped when the engines are destroyed
+  }
+  if (success) {
+    // the files are opened again by new engines in the opposite order
+    EngineContext b;
+    EngineContext a;
+    b.setStorageFile(path_b);
+    a.setStorageFile(path_a);
+    if (!b.init() || !a.init()) {
+      printf("failed to init the engines\n");
+      success = false;
+    } else {
+      success = check_mode(a, BRIGHTNESS_A, PATTERN_A, "reopened file a") &&
+        check_mode(b, BRIGHTNESS_B, PATTERN_B, "reopened file b");
+    }
+  }
+  unlink(path_a);
+  unlink(path_b);
+  return success;
+}
+
+// two engines played a tick at a time in turns play exactly the same as an
+// engine that is played alone
+static bool check_ticks()
+{
+  EngineContext a;
+  EngineContext b;
+  EngineContext alone;
+  if (!a.init() || !b.init() || !alone.init()) {
+    printf("failed to init the engines\n");
+    return false;
+  }
+  save_mode(a, BRIGHTNESS_A, PATTERN_A);
+  save_mode(alone, BRIGHTNESS_A, PATTERN_A);
+  save_mode(b, BRIGHTNESS_B, PATTERN_B);
+  // init again so the engines load the modes they saved
+  if (!a.init() || !b.init() || !alone.init()) {
+    printf("failed to init the engines\n");
+    return false;
+  }
+  std::vector<RGBColor> colors;
+  colors.reserve(CHECK_TICKS);
+  for (uint32_t i = 0; i < CHECK_TICKS; ++i) {
+    alone.tick();
+    colors.push_back(alone.ledColor());
+  }
+  for (uint32_t i = 0; i < CHECK_TICKS; ++i) {
+    a.tick();
+    b.tick();
+    if (!(a.ledColor() == colors[i])) {
+      printf("the engine played differently next to another engine at tick %u\n", i);
+      return false;
+    }
+  }
+  return true;
+}
@@ -169,7 +169,7 @@ while true; do
   echo "--------------------------------------------------------------------------------" >> "$TEST_FILE"
 
   # generate the history for the test and append it to the test file
-  echo "${NEW_INPUT}" | ../$HELIOS $ARGS --hex --no-timestep >> "$TEST_FILE"
+  echo "${NEW_INPUT}" | ../$HELIOS $ARGS --rle --no-timestep >> "$TEST_FILE"
 
   # strip any \r in case this was run on windows
   sed -i 's/\r//g' $TEST_FILE
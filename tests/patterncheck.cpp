@@ -0,0 +1,349 @@
+// checks that the pattern timeline gives exactly the same colors as playing
+// the pattern one tick at a time for a sample of patterns and colorsets, that
+// the transient and period it finds are exact and that the cli renders
+// exactly that many ticks with --cycle
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "PatternTimeline.h"
+#include "TimeControl.h"
+#include "Patterns.h"
+#include "Pattern.h"
+#include "Random.h"
+#include "Led.h"
+
+// how many ticks of each pattern are played and checked
+#define CHECK_TICKS 3000
+
+// how many colorsets each of the built in patterns is checked with
+#define COLORSETS_PER_PATTERN 8
+
+// how many patterns with random args are checked
+#define NUM_RANDOM_PATTERNS 2000
+
+// the period is only checked for patterns that settle into it within this
+// many ticks, some blends take far too long to play all the way through
+#define MAX_PERIOD_TICKS (1u << 20)
+
+// the patterns with the largest timings are checked further than that
+#define MAX_LARGE_PERIOD_TICKS (1u << 22)
+
+// the cli that is run to check --cycle relative to the tests directory,
+// tests/Makefile builds it
+#define HELIOS_CLI_PATH "../HeliosCLI/helios"
+
+// how many periods the cli renders with --cycle
+#define CLI_CYCLES 3
+
+static void random_colorset(Random &ctx, Colorset &set);
+static void random_args(Random &ctx, PatternArgs &args);
+static void play_pattern(const Pattern &pat, std::vector<RGBColor> &colors, uint32_t ticks);
+static bool check_color_at(const Pattern &pat, Random &ctx);
+static bool check_period(const Pattern &pat, uint32_t &checked, uint32_t max_ticks);
+static bool check_large();
+static bool check_cycle(const char *args, const char *colors);
+static void print_pattern(const Pattern &pat);
+
+// the path to the cli, found next to this program
+static std::string cli_path;
+
+int main(int argc, char *argv[])
+{
+  std::string program = argv[0];
+  size_t slash = program.find_last_of('/');
+  cli_path = (slash == std::string::npos) ? "" : program.substr(0, slash + 1);
+  cli_path += HELIOS_CLI_PATH;
+  // the patterns are played as fast as possible one tick at a time
+  Time::enableTimestep(false);
+  Random ctx(0x48454C49);
+  std::vector<Pattern> patterns;
+  // every built in pattern with a few different colorsets
+  for (int id = PATTERN_FIRST; id <= PATTERN_LAST; ++id) {
+    for (uint8_t i = 0; i < COLORSETS_PER_PATTERN; ++i) {
+      Pattern pat;
+      Patterns::make_pattern((PatternID)id, pat);
+      random_colorset(ctx, pat.colorset());
+      patterns.push_back(pat);
+    }
+  }
+  // then random args, these cover the dashes, groups and blends that none
+  // of the built in patterns use
+  for (uint32_t i = 0; i < NUM_RANDOM_PATTERNS; ++i) {
+    PatternArgs args;
+    random_args(ctx, args);
+    Pattern pat(args);
+    random_colorset(ctx, pat.colorset());
+    patterns.push_back(pat);
+  }
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    if (!check_color_at(patterns[i], ctx)) {
+      return 1;
+    }
+  }
+  printf("colorAt: all %zu patterns match play() for %u ticks\n", patterns.size(), CHECK_TICKS);
+  uint32_t checked = 0;
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    if (!check_period(patterns[i], checked, MAX_PERIOD_TICKS)) {
+      return 1;
+    }
+  }
+  printf("period: all %u patterns that settle within %u ticks repeat exactly\n", checked, MAX_PERIOD_TICKS);
+  if (!check_large()) {
+    return 1;
+  }
+  printf("large timings: the timeline finds the period without playing it out\n");
+  // a plain blink, a blend that takes a while to settle, a dash with a gap
+  // and a group with a dash and a gap
+  bool success = true;
+  success &= check_cycle("3,7", "ff0000,00ff00,0000ff");
+  success &= check_cycle("2,3,0,0,0,5", "ff0000,0000ff,00ff00");
+  success &= check_cycle("3,2,10,8", "ff0000,00ff00,0000ff,ff0000");
+  success &= check_cycle("1,4,12,6,2", "ff8000,0080ff,ffffff");
+  if (!success) {
+    return 1;
+  }
+  printf("--cycle: the cli renders exactly %u periods after the transient\n", CLI_CYCLES);
+  return 0;
+}
+
+static void random_colorset(Random &ctx, Colorset &set)
+{
+  set.clear();
+  uint8_t numColors = ctx.next8(1, NUM_COLOR_SLOTS);
+  for (uint8_t i = 0; i < numColors; ++i) {
+    // sometimes repeat the last color, the timeline has to find the
+    // shortest cycle of the colors and not just the colorset
+    if (i > 0 && ctx.next8(0, 4) == 0) {
+      set.addColor(set.get(i - 1));
+      continue;
+    }
+    set.addColor(RGBColor(ctx.next8(), ctx.next8(), ctx.next8()));
+  }
+}
+
+static void random_args(Random &ctx, PatternArgs &args)
+{
+  args.on_dur = ctx.next8(0, 10);
+  args.off_dur = ctx.next8(0, 10);
+  args.gap_dur = ctx.next8(0, 3) ? 0 : ctx.next8(1, 30);
+  args.dash_dur = ctx.next8(0, 3) ? 0 : ctx.next8(1, 20);
+  args.group_size = ctx.next8(0, 2) ? 0 : ctx.next8(1, 7);
+  args.blend_speed = ctx.next8(0, 1) ? 0 : ctx.next8(1, 20);
+}
+
+// play a pattern from init the same way the engine does and record the
+// color of the led after each tick
+static void play_pattern(const Pattern &pat, std::vector<RGBColor> &colors, uint32_t ticks)
+{
+  Pattern playing = pat;
+  Time::init();
+  Led::init();
+  playing.init();
+  colors.clear();
+  for (uint32_t i = 0; i < ticks; ++i) {
+    playing.play();
+    Led::update();
+    colors.push_back(Led::get());
+    Time::tickClock();
+  }
+}
+
+static bool check_color_at(const Pattern &pat, Random &ctx)
+{
+  std::vector<RGBColor> expected;
+  play_pattern(pat, expected, CHECK_TICKS);
+  Pattern fresh = pat;
+  fresh.init();
+  PatternTimeline timeline(fresh);
+  // the timeline is meant for seeking so check the ticks out of order
+  std::vector<uint32_t> ticks(CHECK_TICKS);
+  for (uint32_t i = 0; i < CHECK_TICKS; ++i) {
+    ticks[i] = i;
+  }
+  for (uint32_t i = CHECK_TICKS - 1; i > 0; --i) {
+    std::swap(ticks[i], ticks[ctx.next16(0, i)]);
+  }
+  for (uint32_t i = 0; i < CHECK_TICKS; ++i) {
+    uint32_t tick = ticks[i];
+    RGBColor actual = timeline.colorAt(tick);
+    if (actual != expected[tick]) {
+      print_pattern(pat);
+      printf("colorAt: tick %u gave %06X instead of %06X\n", tick, actual.raw(), expected[tick].raw());
+      return false;
+    }
+  }
+  return true;
+}
+
+static void print_pattern(const Pattern &pat)
+{
+  PatternArgs args = pat.getArgs();
+  printf("pattern %u,%u,%u,%u,%u,%u colors", args.on_dur, args.off_dur, args.gap_dur,
+    args.dash_dur, args.group_size, args.blend_speed);
+  Colorset set = pat.getColorset();
+  for (uint8_t i = 0; i < set.numColors(); ++i) {
+    printf(" %06X", set.get(i).raw());
+  }
+  printf("\n");
+}
+
+// the transient and period of the timeline have to be exact: the colors
+// repeat with the period from the end of the transient on, but not from the
+// tick before it, and not with any shorter period
+static bool check_period(const Pattern &pat, uint32_t &checked, uint32_t max_ticks)
+{
+  Pattern fresh = pat;
+  fresh.init();
+  PatternTimeline timeline(fresh);
+  uint32_t transient = timeline.transient();
+  uint32_t period = timeline.period();
+  if (!period) {
+    print_pattern(pat);
+    printf("period: the period is 0\n");
+    return false;
+  }
+  if ((uint64_t)transient + (2 * (uint64_t)period) > max_ticks) {
+    return true;
+  }
+  std::vector<RGBColor> colors;
+  play_pattern(pat, colors, transient + (2 * period));
+  for (uint32_t tick = transient; tick < transient + period; ++tick) {
+    if (colors[tick] != colors[tick + period]) {
+      print_pattern(pat);
+      printf("period: tick %u doesn't repeat after %u ticks\n", tick, period);
+      return false;
+    }
+  }
+  if (transient > 0 && colors[transient - 1] == colors[transient - 1 + period]) {
+    print_pattern(pat);
+    printf("period: the transient of %u ticks could be shorter\n", transient);
+    return false;
+  }
+  // any shorter period divides this one, so it's enough to check the period
+  // divided by each of its prime factors
+  uint32_t factors = period;
+  for (uint32_t prime = 2; prime <= factors; ++prime) {
+    if (factors % prime) {
+      continue;
+    }
+    while (factors % prime == 0) {
+      factors /= prime;
+    }
+    uint32_t shorter = period / prime;
+    bool repeats = true;
+    for (uint32_t tick = transient; repeats && tick < transient + period; ++tick) {
+      repeats = (colors[tick] == colors[tick + shorter]);
+    }
+    if (repeats) {
+      print_pattern(pat);
+      printf("period: the period of %u ticks could be %u\n", period, shorter);
+      return false;
+    }
+  }
+  checked++;
+  return true;
+}
+
+// the biggest groups with the longest gaps and dashes and the slowest blend,
+// one full repeat of the cycle of these is up to hundreds of millions of ticks
+// so the timeline must find the period without laying out each tick of it
+static bool check_large()
+{
+  // every timing at its largest settles within a few million ticks so it is
+  // played out and checked like the rest
+  Pattern longest(255, 255, 255, 255, 255, 1);
+  longest.colorset().addColor(RGBColor(0xFF0000));
+  longest.colorset().addColor(RGBColor(0x00FF00));
+  longest.colorset().addColor(RGBColor(0x0000FF));
+  uint32_t checked = 0;
+  if (!check_period(longest, checked, MAX_LARGE_PERIOD_TICKS)) {
+    return false;
+  }
+  if (!checked) {
+    print_pattern(longest);
+    printf("large timings: the period is longer than %u ticks\n", MAX_LARGE_PERIOD_TICKS);
+    return false;
+  }
+  // this one repeats every 62619330 ticks, which was checked to be exact by
+  // playing it out once but that takes far too long to do on every run
+  Pattern slowest(245, 241, 66, 0, 253, 1);
+  slowest.colorset().addColor(RGBColor(0xFF0000));
+  slowest.colorset().addColor(RGBColor(0x0000FF));
+  slowest.init();
+  PatternTimeline timeline(slowest);
+  uint32_t transient = timeline.transient();
+  uint32_t period = timeline.period();
+  if (transient != 0 || period != 62619330) {
+    print_pattern(slowest);
+    printf("large timings: found a transient of %u and a period of %u instead of 0 and 62619330\n",
+      transient, period);
+    return false;
+  }
+  return true;
+}
+
+// run the cli with --cycle and check that it skips the transient and then
+// renders exactly the requested number of periods of the pattern, the args
+// and colors are given the same way as -A and -C but the colors are only hex
+static bool check_cycle(const char *args, const char *colors)
+{
+  if (access(cli_path.c_str(), X_OK) != 0) {
+    printf("--cycle: could not find %s\n", cli_path.c_str());
+    return false;
+  }
+  // make the same pattern the cli does out of the args and colors
+  uint8_t vals[6] = { 0 };
+  char *pos = (char *)args;
+  for (uint8_t i = 0; i < 6 && *pos; ++i) {
+    vals[i] = (uint8_t)strtoul(pos, &pos, 10);
+    if (*pos == ',') {
+      pos++;
+    }
+  }
+  Pattern pat(vals[0], vals[1], vals[2], vals[3], vals[4], vals[5]);
+  pos = (char *)colors;
+  while (*pos) {
+    pat.colorset().addColor(RGBColor(strtoul(pos, &pos, 16)));
+    if (*pos == ',') {
+      pos++;
+    }
+  }
+  Pattern fresh = pat;
+  fresh.init();
+  PatternTimeline timeline(fresh);
+  uint32_t first = timeline.transient();
+  uint32_t end = first + (CLI_CYCLES * timeline.period());
+  std::vector<RGBColor> expected;
+  play_pattern(pat, expected, end);
+  char command[256];
+  snprintf(command, sizeof(command), "%s -xt --cycle=%u -A %s -C %s < /dev/null",
+    cli_path.c_str(), CLI_CYCLES, args, colors);
+  FILE *cli = popen(command, "r");
+  if (!cli) {
+    printf("--cycle: could not run %s\n", command);
+    return false;
+  }
+  // each line of hex output is one tick, starting right after the transient
+  char line[64];
+  uint32_t tick = first;
+  while (fgets(line, sizeof(line), cli)) {
+    if (tick < end && strtoul(line, NULL, 16) != expected[tick].raw()) {
+      printf("--cycle: -A %s -C %s gave %.6s on tick %u instead of %06X\n", args, colors,
+        line, tick, expected[tick].raw());
+      pclose(cli);
+      return false;
+    }
+    tick++;
+  }
+  pclose(cli);
+  if (tick != end) {
+    printf("--cycle: -A %s -C %s rendered %u ticks instead of %u\n", args, colors, tick - first, end - first);
+    return false;
+  }
+  return true;
+}
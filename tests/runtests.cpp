@@ -0,0 +1,441 @@
+// Native test runner for the Helios integration tests, this parses the .test
+// files directly then runs each test against the engine in-process. Each test
+// gets a fresh EngineContext so the tests are spread across all of the cores
+// and the output is compared in memory instead of spawning the cli and diffing.
+// Every test is run one tick at a time like the device and then again with
+// the idle ticks fast forwarded like the cli, both have to match
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include "EngineContext.h"
+#include "HeliosLib.h"
+#include "Storage.h"
+#include "Helios.h"
+#include "Button.h"
+#include "Led.h"
+
+// the folder the tests are in and the line that divides the header of a test
+// from the expected output of the test
+#define TESTS_DIR "tests"
+#define TEST_DIVIDER "--------------------------------------------------------------------------------"
+
+// the same options valgrind is run with by runtests.sh
+#define VALGRIND_ARGS "--quiet", "--leak-check=full", "--show-leak-kinds=all", "--error-exitcode=1"
+
+// one run of the same color, the output is recorded as runs the same as --rle
+struct ColorRun
+{
+  uint32_t color;
+  uint32_t count;
+};
+
+struct TestCase
+{
+  std::string filename;
+  uint32_t number;
+  std::string input;
+  std::string brief;
+  std::string args;
+  std::vector<ColorRun> expected;
+  // the output of the engine run one tick at a time and then the output
+  // with the idle ticks skipped by fast_forward
+  std::vector<ColorRun> output;
+  std::vector<ColorRun> fastOutput;
+  bool valid;
+  bool passed;
+  // where the output first went wrong when the test fails and whether
+  // that was in the fast forwarded output
+  uint32_t divergeTick;
+  bool fastForwardFailed;
+};
+
+// various globals for the runner
+bool verbose = false;
+bool audit = false;
+bool use_valgrind = false;
+int todo = -1;
+
+static void parse_options(int argc, char *argv[]);
+static void exec_valgrind(int argc, char *argv[]);
+static bool load_tests(std::vector<TestCase> &tests);
+static bool parse_test(TestCase &test);
+static bool parse_run(const std::string &line, ColorRun &run);
+static void run_test(TestCase &test);
+static void run_engine(const TestCase &test, std::vector<ColorRun> &output, bool fastForward);
+static void record(std::vector<ColorRun> &runs, uint32_t color, uint32_t count);
+static bool find_divergence(TestCase &test, const std::vector<ColorRun> &output);
+static bool confirm_test(const TestCase &test);
+static void print_runs(const std::vector<ColorRun> &runs);
+static void print_divergence(const TestCase &test);
+
+int main(int argc, char *argv[])
+{
+  parse_options(argc, argv);
+  if (use_valgrind) {
+    // the whole runner is run again under valgrind
+    exec_valgrind(argc, argv);
+  }
+  std::vector<TestCase> tests;
+  if (!load_tests(tests)) {
+    return 1;
+  }
+  printf("\x1B[33m== [\x1B[97mRunning %zu Helios Integration Tests\x1B[33m] ==\x1B[0m\n", tests.size());
+  fflush(stdout);
+
+  // verbose and audit stop at the first failure so they only run one at a time,
+  // otherwise every test runs up front spread across all the cores
+  bool serial = (verbose || audit);
+  if (!serial) {
+    uint32_t numThreads = std::thread::hardware_concurrency();
+    if (!numThreads) {
+      numThreads = 1;
+    }
+    std::atomic<uint32_t> nextTest(0);
+    auto worker = [&]() {
+      uint32_t index;
+      while ((index = nextTest.fetch_add(1)) < tests.size()) {
+        run_test(tests[index]);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < numThreads; ++i) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+  bool allSuccess = true;
+  for (size_t i = 0; i < tests.size(); ++i) {
+    TestCase &test = tests[i];
+    if (audit && !confirm_test(test)) {
+      break;
+    }
+    if (serial) {
+      run_test(test);
+    }
+    printf("\x1B[33mRunning test (%zu/%zu) [\x1B[97m%s\x1B[33m] ", i + 1, tests.size(), test.brief.c_str());
+    if (test.args.length() > 0) {
+      printf("[\x1B[97m%s\x1B[33m] ", test.args.c_str());
+    }
+    printf("... \x1B[0m");
+    if (verbose) {
+      print_runs(test.output);
+    }
+    if (test.passed) {
+      printf("\x1B[32mSUCCESS\x1B[0m\n");
+      continue;
+    }
+    printf("\x1B[31mFAILURE\x1B[0m\n");
+    print_divergence(test);
+    allSuccess = false;
+    if (verbose) {
+      break;
+    }
+  }
+  if (!allSuccess) {
+    printf("\x1B[31m== FAILURE ==\x1B[0m\n");
+    return 1;
+  }
+  printf("\x1B[33m== [\x1B[32mSUCCESS ALL TESTS PASSED\x1B[33m] ==\x1B[0m\n");
+  return 0;
+}
+
+// parse the command line options into global flags
+static void parse_options(int argc, char *argv[])
+{
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[i], "-a") == 0) {
+      audit = true;
+      verbose = true;
+    } else if (strcmp(argv[i], "-f") == 0) {
+      use_valgrind = true;
+    } else if (strncmp(argv[i], "-t=", 3) == 0) {
+      todo = (int)strtoul(argv[i] + 3, NULL, 10);
+    }
+  }
+  // same as runtests.sh, valgrind isn't used with verbose output
+  if (verbose) {
+    use_valgrind = false;
+  }
+}
+
+// re-execute the runner under valgrind without the -f flag
+static void exec_valgrind(int argc, char *argv[])
+{
+  std::vector<const char *> args = { "valgrind", VALGRIND_ARGS, argv[0] };
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-f") != 0) {
+      args.push_back(argv[i]);
+    }
+  }
+  args.push_back(nullptr);
+  execvp(args[0], (char * const *)args.data());
+  perror("Failed to run valgrind");
+  exit(1);
+}
+
+// find and parse all of the tests, or just the one that was picked with -t
+static bool load_tests(std::vector<TestCase> &tests)
+{
+  DIR *dir = opendir(TESTS_DIR);
+  if (!dir) {
+    printf("\x1B[31mCould not open %s folder\x1B[0m\n", TESTS_DIR);
+    return false;
+  }
+  std::vector<std::string> filenames;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    std::string name = entry->d_name;
+    if (name.length() < 5 || name.compare(name.length() - 5, 5, ".test") != 0) {
+      continue;
+    }
+    if (todo >= 0 && strtoul(name.c_str(), NULL, 10) != (uint32_t)todo) {
+      continue;
+    }
+    filenames.push_back(name);
+  }
+  closedir(dir);
+  if (!filenames.size()) {
+    if (todo >= 0) {
+      printf("Could not find test %d\n", todo);
+    } else {
+      printf("\x1B[31mNo tests found in %s folder\x1B[0m\n", TESTS_DIR);
+    }
+    return false;
+  }
+  std::sort(filenames.begin(), filenames.end());
+  tests.resize(filenames.size());
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    tests[i].filename = std::string(TESTS_DIR "/") + filenames[i];
+    tests[i].number = strtoul(filenames[i].c_str(), NULL, 10);
+    tests[i].valid = parse_test(tests[i]);
+    tests[i].passed = false;
+    tests[i].divergeTick = 0;
+    tests[i].fastForwardFailed = false;
+  }
+  return true;
+}
+
+// parse the header and expected output of a test file
+static bool parse_test(TestCase &test)
+{
+  std::ifstream file(test.filename);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  bool inOutput = false;
+  while (std::getline(file, line)) {
+    // strip any \r in case this was recorded on windows
+    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+    if (inOutput) {
+      ColorRun run;
+      if (!parse_run(line, run)) {
+        return false;
+      }
+      test.expected.push_back(run);
+    } else if (line == TEST_DIVIDER) {
+      inOutput = true;
+    } else if (line.compare(0, 6, "Input=") == 0) {
+      test.input = line.substr(6);
+    } else if (line.compare(0, 6, "Brief=") == 0) {
+      test.brief = line.substr(6);
+    } else if (line.compare(0, 5, "Args=") == 0) {
+      test.args = line.substr(5);
+    }
+  }
+  return inOutput;
+}
+
+// parse one line of --rle output, ex: FF0000x25 or just FF0000
+static bool parse_run(const std::string &line, ColorRun &run)
+{
+  if (line.length() < 6) {
+    return false;
+  }
+  char *end = nullptr;
+  std::string hex = line.substr(0, 6);
+  run.color = strtoul(hex.c_str(), &end, 16);
+  if (*end) {
+    return false;
+  }
+  run.count = 1;
+  if (line.length() > 6) {
+    if (line[6] != 'x') {
+      return false;
+    }
+    run.count = strtoul(line.c_str() + 7, &end, 10);
+    if (*end || !run.count) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// run a test one tick at a time the same way the device does, then again
+// skipping over the idle ticks the same way the cli does with --no-timestep,
+// both of them have to give exactly the expected output
+static void run_test(TestCase &test)
+{
+  if (!test.valid) {
+    return;
+  }
+  run_engine(test, test.output, false);
+  run_engine(test, test.fastOutput, true);
+  test.fastForwardFailed = false;
+  test.passed = !find_divergence(test, test.output);
+  if (test.passed) {
+    test.fastForwardFailed = find_divergence(test, test.fastOutput);
+    test.passed = !test.fastForwardFailed;
+  }
+}
+
+// run the inputs of a test in a fresh engine and record the output
+static void run_engine(const TestCase &test, std::vector<ColorRun> &output, bool fastForward)
+{
+  EngineContext engine;
+  engine.exchange();
+  // the only arg the tests use is --storage, without it storage is disabled
+  Storage::enableStorage(test.args.find("--storage") != std::string::npos);
+  Helios::init();
+  Helios::set_mode_index(0);
+  HeliosLib::queueInputs(test.input.c_str());
+  while (Helios::keep_going()) {
+    // the cli would keep running forever if the input never quits
+    if (!Button::inputQueueSize()) {
+      break;
+    }
+    uint32_t numTicks = fastForward ? Helios::fast_forward(UINT32_MAX) : 0;
+    if (!numTicks) {
+      Helios::tick();
+      numTicks = 1;
+    }
+    // the cli doesn't render anything while asleep
+    if (Helios::is_asleep()) {
+      continue;
+    }
+    record(output, Led::get().raw(), numTicks);
+  }
+  engine.exchange();
+}
+
+// add some ticks of a color to the end of the recorded runs
+static void record(std::vector<ColorRun> &runs, uint32_t color, uint32_t count)
+{
+  if (runs.size() && runs.back().color == color) {
+    runs.back().count += count;
+    return;
+  }
+  ColorRun run = { color, count };
+  runs.push_back(run);
+}
+
+// walk the expected and actual runs together to find the first tick where
+// they are different, returns false if they are the same all the way through
+static bool find_divergence(TestCase &test, const std::vector<ColorRun> &output)
+{
+  size_t e = 0;
+  size_t o = 0;
+  uint32_t expectedLeft = test.expected.size() ? test.expected[0].count : 0;
+  uint32_t outputLeft = output.size() ? output[0].count : 0;
+  uint32_t tick = 0;
+  while (e < test.expected.size() && o < output.size()) {
+    if (test.expected[e].color != output[o].color) {
+      test.divergeTick = tick;
+      return true;
+    }
+    uint32_t step = std::min(expectedLeft, outputLeft);
+    tick += step;
+    expectedLeft -= step;
+    outputLeft -= step;
+    if (!expectedLeft && ++e < test.expected.size()) {
+      expectedLeft = test.expected[e].count;
+    }
+    if (!outputLeft && ++o < output.size()) {
+      outputLeft = output[o].count;
+    }
+  }
+  test.divergeTick = tick;
+  // if either one has anything left then one is longer than the other
+  return (e < test.expected.size() || o < output.size());
+}
+
+// the audit prompts before each test
+static bool confirm_test(const TestCase &test)
+{
+  printf("\x1B[33mBegin test? (Y/n): \x1B[97m");
+  fflush(stdout);
+  char buf[32] = { 0 };
+  if (!fgets(buf, sizeof(buf), stdin) || buf[0] == 'n' || buf[0] == 'N') {
+    return false;
+  }
+  printf("\n-----------------------------\n");
+  printf("Input: %s\n", test.input.c_str());
+  printf("Brief: %s\n", test.brief.c_str());
+  printf("Args: %s\n", test.args.c_str());
+  printf("Test: %u\n", test.number);
+  printf("-----------------------------\n");
+  return true;
+}
+
+// print runs of colors with console color codes, like the cli --color
+static void print_runs(const std::vector<ColorRun> &runs)
+{
+  printf("\n");
+  for (const ColorRun &run : runs) {
+    printf("\x1B[0m[\x1B[48;2;%u;%u;%um  \x1B[0m] x%u\n", (run.color >> 16) & 0xFF,
+      (run.color >> 8) & 0xFF, run.color & 0xFF, run.count);
+  }
+}
+
+// print where a test went wrong
+static void print_divergence(const TestCase &test)
+{
+  if (!test.valid) {
+    printf("  Could not parse %s\n", test.filename.c_str());
+    return;
+  }
+  // find the color that each of them had on the tick that they diverged
+  auto color_at = [](const std::vector<ColorRun> &runs, uint32_t tick, uint32_t &color) {
+    for (const ColorRun &run : runs) {
+      if (tick < run.count) {
+        color = run.color;
+        return true;
+      }
+      tick -= run.count;
+    }
+    return false;
+  };
+  uint32_t expected = 0;
+  uint32_t output = 0;
+  bool hasExpected = color_at(test.expected, test.divergeTick, expected);
+  bool hasOutput = color_at(test.fastForwardFailed ? test.fastOutput : test.output, test.divergeTick, output);
+  printf("  %s first diverges at tick %u%s: expected ", test.filename.c_str(), test.divergeTick,
+    test.fastForwardFailed ? " when fast forwarded" : "");
+  if (hasExpected) {
+    printf("%06X", expected);
+  } else {
+    printf("end of output");
+  }
+  printf(" but got ");
+  if (hasOutput) {
+    printf("%06X\n", output);
+  } else {
+    printf("end of output\n");
+  }
+}